@@ -1,10 +1,15 @@
 from __future__ import absolute_import, division, print_function, unicode_literals
 
+import argparse
+import math
+import multiprocessing
 import os
 import os.path
+import re
 import signal
 import subprocess
 import sys
+import threading
 from threading import Timer
 
 
@@ -21,6 +26,65 @@ all_programs = [
     'stl_map',
     'custom',
     'sparsepp',
+    'custom_map',
+    'my_robin_hood',
+    'group_probe',
+    'custom_map_wyhash',
+    'custom_map_crc32c',
+    'sharded_custom',
+    'locked_unordered_map',
+    'seqlock_robin_hood',
+    'custom_map_strkey',
+    'my_robin_hood_strkey',
+    'custom_map_compact',
+    'custom_map_compact32',
+    'custom_map_incremental',
+    'my_robin_hood_incremental',
+    'robin_hood_backshift',
+    'custom_map_4k',
+    'custom_map_hugepages',
+    'robin_hood_4k',
+    'robin_hood_hugepages',
+    'custom_map_identity',
+    'custom_map_avalanche',
+    'my_robin_hood_identity',
+    'my_robin_hood_splitmeta',
+    'my_robin_hood_split',
+    'my_robin_hood_v64',
+    'my_robin_hood_splitmeta_v64',
+    'my_robin_hood_split_v64',
+    'cuckoo',
+    'art',
+]
+
+# programs that can run the "<benchtype>-t<threads>" benchmarks (template.c -t)
+threaded_programs = [
+    'sharded_custom',
+    'locked_unordered_map',
+    'seqlock_robin_hood',
+]
+
+# programs whose tables build in parallel in "bulkload-t<threads>" (template.c BULK_LOAD_INT_INTO_HASH)
+bulk_programs = [
+    'custom_map',
+    'my_robin_hood',
+    'custom_map_compact',
+    'custom_map_compact32',
+]
+
+# programs whose int tables can be written to a file and attached again, for save and load (template.c SAVE_INT_HASH)
+file_programs = [
+    'custom_map',
+    'my_robin_hood',
+    'custom_map_compact',
+    'my_robin_hood_splitmeta',
+    'my_robin_hood_split',
+]
+
+# ordered programs that can count the keys in a range, for rangescan (template.c RANGE_COUNT_INT_IN_HASH)
+range_programs = [
+    'stl_map',
+    'art',
 ]
 
 programs = []
@@ -47,64 +111,218 @@ programs = [
 minkeys = 128
 maxkeys = 5 * 1000 * 1000
 interval = 2
-best_out_of = 3
+# every case runs between min_runs and max_runs times, stopping once the 95%
+# confidence interval of the mean runtime is within ci_target of the mean
+min_runs = 3
+max_runs = 15
+ci_target = 0.02
+# a run gets timeout_seconds plus timeout_seconds_per_key for every key
 timeout_seconds = 3
+timeout_seconds_per_key = 2e-6
+ncpus = multiprocessing.cpu_count()
+thread_counts = sorted(set([n for n in (1, 2, 4, 8) if n < ncpus] + [ncpus]))
 
 # for the final run, use this:
 # minkeys  =  2*1000*1000
 # maxkeys  = 40*1000*1000
 # interval =  2*1000*1000
-# best_out_of = 3
-# and use nice/ionice
+# and use nice/ionice, -j with one core per job, leaving core 0 alone
 # and shut down to the console
 # and swapoff any swap files/partitions
 
-if len(sys.argv) > 1:
-    benchtypes = sys.argv[1:]
+parser = argparse.ArgumentParser(description='Run the benchmarks that are out of date and append them to build/<program>.csv.')
+parser.add_argument('benchtypes', nargs='*', help='benchtypes to run, "-t<N>" and "-l<N>" suffixes pass -t N and -l N')
+parser.add_argument('-j', '--jobs', type=int, default=1,
+                    help='run this many (benchtype, program) series at once, each pinned to a core of its own')
+parser.add_argument('-c', '--cpus', default=None,
+                    help='comma separated cores to pin the runs to, highest numbered first by default')
+parser.add_argument('--trace', default=None,
+                    help='a trace from make_trace.py for the replay benchtype, which is added if it is not there')
+cli = parser.parse_args()
+
+if cli.benchtypes:
+    benchtypes = cli.benchtypes
+else:
+    benchtypes = ('sequential', 'random', 'strided', 'sequentialpresized', 'randompresized', 'delete', 'lookup', 'lookuphit', 'lookupmiss', 'sequentialstring', 'randomstring', 'deletestring', 'lookupstring', 'lookupbatch', 'lookupbatchstring', 'filllatency')
+    benchtypes += tuple('%s-t%d' % (b, n) for b in ('lookup', 'mixed', 'readmostly') for n in thread_counts)
+    benchtypes += ('random-l16', 'lookup-l16', 'lookupstring-l16')
+    benchtypes += ('ycsb-a', 'ycsb-b', 'ycsb-c', 'ycsb-d', 'ycsb-f', 'ycsb-hot')
+    benchtypes += ('bulkload',) + tuple('bulkload-t%d' % n for n in thread_counts)
+    benchtypes += ('churn',)
+    benchtypes += ('save', 'load')
+    benchtypes += ('rangescan',)
+
+if cli.trace and 'replay' not in benchtypes:
+    benchtypes = tuple(benchtypes) + ('replay',)
+elif 'replay' in benchtypes and not cli.trace:
+    sys.exit('replay needs --trace')
+
+if cli.cpus:
+    cpus = [int(cpu) for cpu in cli.cpus.split(',')]
 else:
-    benchtypes = ('sequential', 'random', 'delete', 'lookup', 'sequentialstring', 'randomstring', 'deletestring', 'lookupstring')
-
-for benchtype in benchtypes:
-    for program in programs:
-        nkeys = minkeys
-        while nkeys <= maxkeys:
-            fastest_attempt = None
-            fastest_attempt_data = ''
-
-            for attempt in range(best_out_of):
-                proc = subprocess.Popen(['./build/' + program, str(nkeys), benchtype], stdout=subprocess.PIPE)
-                kill_proc = (lambda p: os.kill(p.pid, signal.SIGKILL))
-                timer = Timer(timeout_seconds, kill_proc, [proc])
-                timer.start()
-
-                # wait for the program to fill up memory and spit out its "ready" message
-                try:
-                    runtime = float(proc.stdout.readline().strip())
-                except Exception:
-                    runtime = 0
-                finally:
-                    timer.cancel()
-
-                ps_proc = subprocess.Popen(['ps up %d | tail -n1' % proc.pid], shell=True, stdout=subprocess.PIPE)
-                nbytes = int(ps_proc.stdout.read().split()[4]) * 1024
-                ps_proc.wait()
-
-                kill_proc(proc)
-                proc.wait()
-
-                if nbytes and runtime:  # otherwise it crashed
-                    line = ','.join(map(str, [benchtype, nkeys, program, nbytes, "%0.6f" % runtime]))
-
-                    if fastest_attempt is None or runtime < fastest_attempt:
-                        fastest_attempt = runtime
-                        fastest_attempt_data = line
-
-            if fastest_attempt is not None:
-                print(fastest_attempt_data)
-                with open('./build/' + program + '.csv', 'a') as f:
-                    f.write(fastest_attempt_data + '\n')
-            else:
+    cpus = list(reversed(range(ncpus)))  # core 0 usually gets the interrupts
+jobs = max(1, min(cli.jobs, len(cpus)))
+
+taskset = next((os.path.join(d, 'taskset') for d in os.environ.get('PATH', '').split(os.pathsep)
+                if os.path.isfile(os.path.join(d, 'taskset'))), None)
+if not taskset:
+    print('taskset not found, the runs will not be pinned', file=sys.stderr)
+
+output_lock = threading.Lock()
+
+
+def run_once(args, cpu, timeout):
+    """runs a benchmark and returns (runtime, nbytes, stats), runtime is 0 if it crashed"""
+    if cpu is not None and taskset:
+        args = [taskset, '-c', str(cpu)] + args
+    proc = subprocess.Popen(args, stdout=subprocess.PIPE)
+    kill_proc = (lambda p: os.kill(p.pid, signal.SIGKILL))
+    timer = Timer(timeout, kill_proc, [proc])
+    timer.start()
+
+    # wait for the program to fill up memory and spit out its "ready" message:
+    # the runtime, then name=value allocation counts if it has them (alloc_stats.h);
+    # it sleeps after that so that ps can see its memory, there's no need to wait
+    try:
+        fields = proc.stdout.readline().decode().split()
+        runtime = float(fields[0])
+        stats = fields[1:]
+    except Exception:
+        runtime = 0
+        stats = []
+    finally:
+        timer.cancel()
+
+    live = [s.split('=')[1] for s in stats if s.startswith('live=')]
+    if live:
+        nbytes = max(int(live[0]), 1)
+    elif runtime:
+        ps_proc = subprocess.Popen(['ps up %d | tail -n1' % proc.pid], shell=True, stdout=subprocess.PIPE)
+        nbytes = int(ps_proc.stdout.read().split()[4]) * 1024
+        ps_proc.wait()
+    else:
+        nbytes = 0
+
+    try:
+        kill_proc(proc)
+    except OSError:
+        pass
+    proc.wait()
+    return runtime, nbytes, stats
+
+
+# two sided 95% critical values of Student's t, by degrees of freedom
+t_95 = [12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086]
+
+
+def summarize(runtimes):
+    """returns (median, min, stddev, ci), ci the half width of the 95% interval of the mean / mean"""
+    n = len(runtimes)
+    ordered = sorted(runtimes)
+    median = ordered[n // 2] if n % 2 else (ordered[n // 2 - 1] + ordered[n // 2]) / 2
+    mean = sum(runtimes) / n
+    stddev = math.sqrt(sum((r - mean) ** 2 for r in runtimes) / (n - 1)) if n > 1 else 0
+    t = t_95[n - 2] if 1 < n <= len(t_95) + 1 else 1.96
+    ci = t * stddev / math.sqrt(n) / mean if mean and n > 1 else float('inf')
+    return median, ordered[0], stddev, ci
+
+
+def run_case(benchtype, program, options, base_benchtype, nkeys, cpu):
+    """runs one (benchtype, program, nkeys) until it's precise enough, returns its csv line or None"""
+    args = ['./build/' + program]
+    for option, value in options:
+        args += ['-' + option, value]
+    if base_benchtype == 'replay':
+        args += ['-f', cli.trace]  # replays the first nkeys operations
+    args += [str(nkeys), base_benchtype]
+    timeout = timeout_seconds + timeout_seconds_per_key * nkeys
+
+    runs = []
+    while len(runs) < max_runs:
+        runtime, nbytes, stats = run_once(args, cpu, timeout)
+        if not (nbytes and runtime):  # it crashed
+            return None
+        runs.append((runtime, nbytes, stats))
+        if len(runs) >= min_runs and summarize([r[0] for r in runs])[3] <= ci_target:
+            break
+
+    median, fastest, stddev, ci = summarize([r[0] for r in runs])
+    # the sizes and counters are those of the run nearest the median
+    runtime, nbytes, stats = min(runs, key=lambda r: abs(r[0] - median))
+    extra = ['min=%0.6f' % fastest, 'stddev=%0.6f' % stddev, 'runs=%d' % len(runs)]
+    return ','.join(map(str, [benchtype, nkeys, program, nbytes, "%0.6f" % median] + stats + extra))
+
+
+def split_benchtype(benchtype):
+    """returns the template.c benchtype and its options"""
+    # "<benchtype>-t<threads>" runs template.c -t, "-l<N>" samples latencies with -l
+    suffixed = re.match(r'(.*?)((?:-[tl]\d+)*)$', benchtype)
+    return suffixed.group(1), re.findall(r'-([tl])(\d+)', suffixed.group(2))
+
+
+def is_threaded(benchtype):
+    return 't' in dict(split_benchtype(benchtype)[1])
+
+
+def run_series(benchtype, program, cpu):
+    """runs benchtype on program from minkeys up to maxkeys, stopping at the first failure"""
+    base_benchtype, options = split_benchtype(benchtype)
+    nkeys = minkeys
+    while nkeys <= maxkeys:
+        line = run_case(benchtype, program, options, base_benchtype, nkeys, cpu)
+        with output_lock:
+            if line is None:
                 print(','.join(map(str, [benchtype, nkeys, program, 'FAILED'])))
+                sys.stdout.flush()
                 break
+            print(line)
+            sys.stdout.flush()
+            with open('./build/' + program + '.csv', 'a') as f:
+                f.write(line + '\n')
+        nkeys *= interval
+
+
+def runs_on(benchtype, program):
+    if benchtype in ('save', 'load'):
+        return program in file_programs
+    if benchtype == 'rangescan':
+        return program in range_programs
+    if not is_threaded(benchtype):
+        return True
+    if split_benchtype(benchtype)[0] == 'bulkload':
+        return program in bulk_programs
+    return program in threaded_programs
+
+
+series = [
+    (benchtype, program)
+    for benchtype in benchtypes
+    for program in programs
+    if runs_on(benchtype, program)
+]
+
+# the single threaded series share out the cores, one per job
+pending = [s for s in series if not is_threaded(s[0])]
+pending_lock = threading.Lock()
+
+
+def worker(cpu):
+    while True:
+        with pending_lock:
+            if not pending:
+                return
+            benchtype, program = pending.pop(0)
+        run_series(benchtype, program, cpu)
+
+
+workers = [threading.Thread(target=worker, args=(cpu,)) for cpu in cpus[:jobs]]
+for w in workers:
+    w.start()
+for w in workers:
+    w.join()
 
-            nkeys *= interval
+# the threaded ones pin their own threads, so they get the machine to themselves
+for benchtype, program in series:
+    if is_threaded(benchtype):
+        run_series(benchtype, program, None)
@@ -21,21 +21,83 @@
 # random,20971520,google_dense_hash_map,548937728,4.85360789299
 # random,41943040,glib_hash_table,1619816448,90.6313672066
 
-import sys, json
+import sys, json, re
 
 lines = [ line.strip() for line in sys.stdin if line.strip() ]
 
 by_benchtype = {}
+scaling = {}
+over_time = {}
 
 for line in lines:
-    benchtype, nkeys, program, nbytes, runtime = line.split(',')
+    fields = line.split(',')
+    benchtype, nkeys, program, nbytes, runtime = fields[:5]
     nkeys = int(nkeys)
     nbytes = int(nbytes)
     runtime = float(runtime)
+    # anything after the runtime is name=value, e.g. the allocation counts
+    extra = dict(field.split('=', 1) for field in fields[5:])
 
     by_benchtype.setdefault("%s-runtime" % benchtype, {}).setdefault(program, []).append([nkeys, runtime])
     if benchtype.startswith('sequential'):
         by_benchtype.setdefault("%s-memory"  % benchtype, {}).setdefault(program, []).append([nkeys, nbytes])
+        if 'live' in extra:
+            by_benchtype.setdefault("%s-bytesperentry" % benchtype, {}).setdefault(program, []).append([nkeys, int(extra['live']) / nkeys])
+            peak = max(int(extra['peak']), int(extra['fill_peak']))
+            by_benchtype.setdefault("%s-peakmemory" % benchtype, {}).setdefault(program, []).append([nkeys, peak])
+
+    # per operation latency percentiles (template.c -l, and filllatency), in us,
+    # charted as "<benchtype>-p99" etc. without the -l<N> suffix
+    if 'max_ns' in extra:
+        base = re.sub(r'-l\d+$', '', benchtype)
+        for percentile in ('p50', 'p90', 'p99', 'p999', 'max'):
+            by_benchtype.setdefault("%s-%s" % (base, percentile), {}).setdefault(program, []).append([nkeys, float(extra[percentile + '_ns']) / 1e3])
+
+    # probe lengths at the end of the run (table_stats.h), e.g. "random-maxprobe"
+    if 'max_probe' in extra:
+        by_benchtype.setdefault("%s-avgprobe" % benchtype, {}).setdefault(program, []).append([nkeys, float(extra['avg_probe'])])
+        by_benchtype.setdefault("%s-maxprobe" % benchtype, {}).setdefault(program, []).append([nkeys, int(extra['max_probe'])])
+
+    # save and load (template.c SAVE_INT_HASH), the first lookup after building
+    # or attaching the table, in us
+    if 'first_lookup_ns' in extra:
+        by_benchtype.setdefault("%s-firstlookup" % benchtype, {}).setdefault(program, []).append([nkeys, float(extra['first_lookup_ns']) / 1e3])
+
+    # hardware counters per operation (perf_counters.h), e.g. "lookup-llc_misses"
+    for name, count in extra.items():
+        if name.endswith('_per_op'):
+            by_benchtype.setdefault("%s-%s" % (benchtype, name[:-len('_per_op')]), {}).setdefault(program, []).append([nkeys, float(count)])
+
+    # "<benchtype>-t<threads>" runs are also charted as ops/sec against threads,
+    # at the largest number of keys that was run
+    threaded = re.match(r'(.*)-t(\d+)$', benchtype)
+    if threaded:
+        runs = scaling.setdefault(threaded.group(1), {}).setdefault(program, {})
+        threads = int(threaded.group(2))
+        if threads not in runs or nkeys > runs[threads][0]:
+            runs[threads] = (nkeys, runtime)
+
+    # churn's stretches (template.c churn_ops_per_sec), charted against how far
+    # into the run they were, at the largest number of keys that was run
+    if 'churn_ops_per_sec' in extra:
+        runs = over_time.setdefault(benchtype, {})
+        if program not in runs or nkeys > runs[program][0]:
+            runs[program] = (nkeys, extra)
+
+for benchtype, programs in over_time.items():
+    for program, (nkeys, extra) in programs.items():
+        for name, chart in (('churn_ops_per_sec', 'throughput'), ('churn_avg_probe', 'avgprobeovertime')):
+            if name in extra:
+                values = [float(v) for v in extra[name].split(':')]
+                by_benchtype.setdefault("%s-%s" % (benchtype, chart), {})[program] = [
+                    [(i + 1.0) / len(values), v] for i, v in enumerate(values)
+                ]
+
+for benchtype, programs in scaling.items():
+    for program, runs in programs.items():
+        by_benchtype.setdefault("%s-scaling" % benchtype, {})[program] = [
+            [threads, nkeys / runtime] for threads, (nkeys, runtime) in sorted(runs.items())
+        ]
 
 proper_names = {
     'boost_unordered_map': 'Boost 1.38 unordered_map',
@@ -50,6 +112,35 @@ proper_names = {
     'stl_map': 'GCC 4.4 std::map',
     'custom': 'Custom',
     'sparsepp': 'Sparsepp',
+    'custom_map': 'Custom (split hash array)',
+    'my_robin_hood': 'HashTable (robin hood)',
+    'group_probe': 'Group probe (SSE2)',
+    'custom_map_wyhash': 'Custom (wyhash strings)',
+    'custom_map_crc32c': 'Custom (crc32c strings)',
+    'sharded_custom': 'Sharded Custom (mutex per shard)',
+    'locked_unordered_map': 'std::unordered_map (global mutex)',
+    'seqlock_robin_hood': 'Seqlock HashTable (lock-free reads)',
+    'custom_map_strkey': 'Custom (inline string keys)',
+    'my_robin_hood_strkey': 'HashTable (inline string keys)',
+    'custom_map_compact': 'Custom (1 byte distance + 1 byte fingerprint)',
+    'custom_map_compact32': 'Custom (1 byte distance + 3 byte fingerprint)',
+    'custom_map_incremental': 'Custom (incremental rehash)',
+    'my_robin_hood_incremental': 'HashTable (incremental rehash)',
+    'robin_hood_backshift': 'Robin Hood Hash (backward shift delete)',
+    'custom_map_4k': 'Custom (mmap, 4K pages)',
+    'custom_map_hugepages': 'Custom (mmap, 2M pages)',
+    'robin_hood_4k': 'Robin Hood Hash (mmap, 4K pages)',
+    'robin_hood_hugepages': 'Robin Hood Hash (mmap, 2M pages)',
+    'custom_map_identity': 'Custom (identity int hash)',
+    'custom_map_avalanche': 'Custom (avalanche int hash)',
+    'my_robin_hood_identity': 'HashTable (identity int hash)',
+    'my_robin_hood_splitmeta': 'HashTable (split distances)',
+    'my_robin_hood_split': 'HashTable (split distances, keys, values)',
+    'my_robin_hood_v64': 'HashTable (64 byte values)',
+    'my_robin_hood_splitmeta_v64': 'HashTable (split distances, 64 byte values)',
+    'my_robin_hood_split_v64': 'HashTable (split distances, keys, values, 64 byte values)',
+    'cuckoo': 'Cuckoo (2 choices, 4 slot buckets, 95% load)',
+    'art': 'Adaptive radix tree',
 }
 
 # do them in the desired order to make the legend not overlap the chart data
@@ -67,6 +158,35 @@ program_slugs = [
     'qt_qhash',
     'custom',
     'sparsepp',
+    'custom_map',
+    'my_robin_hood',
+    'group_probe',
+    'custom_map_wyhash',
+    'custom_map_crc32c',
+    'sharded_custom',
+    'locked_unordered_map',
+    'seqlock_robin_hood',
+    'custom_map_strkey',
+    'my_robin_hood_strkey',
+    'custom_map_compact',
+    'custom_map_compact32',
+    'custom_map_incremental',
+    'my_robin_hood_incremental',
+    'robin_hood_backshift',
+    'custom_map_4k',
+    'custom_map_hugepages',
+    'robin_hood_4k',
+    'robin_hood_hugepages',
+    'custom_map_identity',
+    'custom_map_avalanche',
+    'my_robin_hood_identity',
+    'my_robin_hood_splitmeta',
+    'my_robin_hood_split',
+    'my_robin_hood_v64',
+    'my_robin_hood_splitmeta_v64',
+    'my_robin_hood_split_v64',
+    'cuckoo',
+    'art',
 ]
 
 chart_data = {}
@@ -0,0 +1,66 @@
+from __future__ import absolute_import, division, print_function, unicode_literals
+
+# Turns a text trace into the binary one template.c's replay mode maps (src/trace.h):
+#
+#   python make_trace.py [--string-keys] < ops.txt > ops.trace
+#   ./build/custom_map -f ops.trace 0 replay
+#
+# One operation per line, "insert KEY [VALUE]", "lookup KEY" or "delete KEY"
+# (or set/get/del, or i/l/d). Keys are 64 bit ints, or with --string-keys
+# anything without whitespace. Values are only written if some line has one.
+
+import argparse
+import struct
+import sys
+
+TRACE_MAGIC = b'HTRACE1\0'
+TRACE_STRING_KEYS = 1
+TRACE_VALUES = 2
+ops = {
+    'insert': 1, 'set': 1, 'i': 1,
+    'lookup': 2, 'get': 2, 'l': 2,
+    'delete': 3, 'del': 3, 'd': 3,
+}
+header_format = '<8sIIQQQQ'  # struct trace_header
+
+parser = argparse.ArgumentParser(description='Convert a text trace to a binary one for template.c -f TRACE replay.')
+parser.add_argument('--string-keys', action='store_true', help='keys are strings rather than ints')
+args = parser.parse_args()
+
+records = []
+strings = bytearray()
+string_offsets = {}  # every distinct key once, so a key is always the same pointer
+has_values = False
+
+for number, line in enumerate(sys.stdin, 1):
+    fields = line.split()
+    if not fields or fields[0].startswith('#'):
+        continue
+    if fields[0] not in ops or len(fields) not in (2, 3):
+        sys.exit('line %d: expected "insert|lookup|delete KEY [VALUE]"' % number)
+    if args.string_keys:
+        key = fields[1].encode('utf-8')
+        if key not in string_offsets:
+            string_offsets[key] = len(strings)
+            strings += key + b'\0'
+        key = string_offsets[key]
+    else:
+        key = int(fields[1])
+    value = int(fields[2]) if len(fields) == 3 else 0
+    has_values = has_values or len(fields) == 3
+    records.append((key, ops[fields[0]], value))
+
+flags = (TRACE_STRING_KEYS if args.string_keys else 0) | (TRACE_VALUES if has_values else 0)
+record_format = '<qIIq' if has_values else '<qII'  # struct trace_record
+record_size = struct.calcsize(record_format)
+records_offset = struct.calcsize(header_format)
+strings_offset = records_offset + record_size * len(records)
+
+out = getattr(sys.stdout, 'buffer', sys.stdout)
+out.write(struct.pack(header_format, TRACE_MAGIC, flags, record_size, len(records), records_offset, strings_offset, len(strings)))
+for key, op, value in records:
+    if has_values:
+        out.write(struct.pack(record_format, key, op, 0, value))
+    else:
+        out.write(struct.pack(record_format, key, op, 0))
+out.write(bytes(strings))
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <stdlib.h>
+#include <stddef.h>
+
+/*
+    Counts heap usage by replacing malloc and friends for the whole process
+    (libstdc++'s operator new and interpreters' allocators included) and
+    passing through to glibc's own __libc_* functions.
+
+    Sizes are malloc_usable_size, so allocator rounding is counted but the
+    allocator's own headers and free lists are not. Only with glibc, and
+    not when built with -DNO_ALLOC_STATS.
+
+    alloc_stats_begin() sets the baseline and starts the first phase,
+    alloc_stats_phase() starts the next one. alloc_stats_end() reports the
+    bytes live now and the peak during the phase, both relative to the
+    baseline, and the number of allocations during the phase.
+*/
+
+struct alloc_stats
+{
+    long live;
+    long peak;
+    long allocs;
+};
+
+#if defined(__GLIBC__) && !defined(NO_ALLOC_STATS)
+
+#define HAVE_ALLOC_STATS 1
+
+#include <errno.h>
+#include <malloc.h> /* malloc_usable_size */
+
+#ifdef __cplusplus
+extern "C" {
+/* the definitions have to match glibc's declarations, which are noexcept in C++ */
+#define ALLOC_STATS_THROW __THROW
+#else
+#define ALLOC_STATS_THROW
+#endif
+
+extern void * __libc_malloc(size_t size);
+extern void * __libc_calloc(size_t n, size_t size);
+extern void * __libc_realloc(void * ptr, size_t size);
+extern void * __libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void * ptr);
+
+static size_t alloc_live, alloc_peak, alloc_count, alloc_base;
+
+static void alloc_stats_add_bytes(size_t bytes, int is_new)
+{
+    size_t live, peak;
+    live = __atomic_add_fetch(&alloc_live, bytes, __ATOMIC_RELAXED);
+    if(is_new)
+        __atomic_add_fetch(&alloc_count, 1, __ATOMIC_RELAXED);
+    peak = __atomic_load_n(&alloc_peak, __ATOMIC_RELAXED);
+    while(live > peak && !__atomic_compare_exchange_n(&alloc_peak, &peak, live, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+static void alloc_stats_add(void * ptr, int is_new)
+{
+    if(ptr)
+        alloc_stats_add_bytes(malloc_usable_size(ptr), is_new);
+}
+
+/* counts memory that bypasses malloc, like slot_alloc.h's mappings, bytes < 0 when it's given back */
+static inline void alloc_stats_mapped(long bytes)
+{
+    if(bytes > 0)
+        alloc_stats_add_bytes((size_t)bytes, 1);
+    else
+        __atomic_sub_fetch(&alloc_live, (size_t)-bytes, __ATOMIC_RELAXED);
+}
+
+static void alloc_stats_sub(void * ptr)
+{
+    if(ptr)
+        __atomic_sub_fetch(&alloc_live, malloc_usable_size(ptr), __ATOMIC_RELAXED);
+}
+
+void * malloc(size_t size) ALLOC_STATS_THROW
+{
+    void * ptr = __libc_malloc(size);
+    alloc_stats_add(ptr, 1);
+    return ptr;
+}
+
+void * calloc(size_t n, size_t size) ALLOC_STATS_THROW
+{
+    void * ptr = __libc_calloc(n, size);
+    alloc_stats_add(ptr, 1);
+    return ptr;
+}
+
+void * realloc(void * ptr, size_t size) ALLOC_STATS_THROW
+{
+    size_t old_size = ptr ? malloc_usable_size(ptr) : 0;
+    void * new_ptr = __libc_realloc(ptr, size);
+    if(new_ptr || !size)
+        __atomic_sub_fetch(&alloc_live, old_size, __ATOMIC_RELAXED);
+    alloc_stats_add(new_ptr, !ptr);
+    return new_ptr;
+}
+
+void * memalign(size_t alignment, size_t size) ALLOC_STATS_THROW
+{
+    void * ptr = __libc_memalign(alignment, size);
+    alloc_stats_add(ptr, 1);
+    return ptr;
+}
+
+void * aligned_alloc(size_t alignment, size_t size) ALLOC_STATS_THROW
+{
+    return memalign(alignment, size);
+}
+
+int posix_memalign(void ** out, size_t alignment, size_t size) ALLOC_STATS_THROW
+{
+    void * ptr;
+    if(alignment % sizeof(void *) || (alignment & (alignment - 1)))
+        return EINVAL;
+    ptr = memalign(alignment, size);
+    if(!ptr)
+        return ENOMEM;
+    *out = ptr;
+    return 0;
+}
+
+void free(void * ptr) ALLOC_STATS_THROW
+{
+    alloc_stats_sub(ptr);
+    __libc_free(ptr);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+static void alloc_stats_phase(void)
+{
+    __atomic_store_n(&alloc_peak, __atomic_load_n(&alloc_live, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+    __atomic_store_n(&alloc_count, 0, __ATOMIC_RELAXED);
+}
+
+static void alloc_stats_begin(void)
+{
+    alloc_base = __atomic_load_n(&alloc_live, __ATOMIC_RELAXED);
+    alloc_stats_phase();
+}
+
+static void alloc_stats_end(struct alloc_stats * stats)
+{
+    stats->live = (long)__atomic_load_n(&alloc_live, __ATOMIC_RELAXED) - (long)alloc_base;
+    stats->peak = (long)__atomic_load_n(&alloc_peak, __ATOMIC_RELAXED) - (long)alloc_base;
+    stats->allocs = (long)__atomic_load_n(&alloc_count, __ATOMIC_RELAXED);
+}
+
+#endif
@@ -0,0 +1,732 @@
+#include <inttypes.h>
+#include <stdint.h>
+#include <cstdlib> // calloc, malloc, free
+#include <cstring> // memcpy, memmove, memcmp, strlen
+#include <new> // bad_alloc, placement new
+#include <utility> // move
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+/*
+    An adaptive radix tree (Leis et al., "The Adaptive Radix Tree: ARTful
+    Indexing for Main-Memory Databases"), ordered by the bytes of the keys.
+
+    Inner nodes come in four sizes, Node4 and Node16 with sorted key bytes
+    (Node16 searched with one SSE2 compare), Node48 with a 256 entry index
+    into 48 children and Node256 with a child per byte, and grow and shrink
+    between them as children come and go. A node keeps the first max_prefix
+    bytes of the path compressed into it; a longer prefix is skipped on the
+    way down and checked against the leaf at the end.
+
+    Children are tagged pointers, the low bit set for leaves, which hold a
+    copy of the key. Keys have to be prefix free, so that every key ends at
+    a leaf: fixed width, or NUL terminated (see ArtIntKey and ArtStringKey).
+    Functions that take a key take anything with data() and size().
+*/
+template <class V>
+class AdaptiveRadixTree {
+public:
+    AdaptiveRadixTree():
+        _root(NULL),
+        _size(0) {
+    }
+
+    ~AdaptiveRadixTree() {
+        destroy(_root);
+    }
+
+    size_t size() const {
+        return _size;
+    }
+
+    template <class Key>
+    V * get(const Key & k) {
+        const unsigned char * key = k.data();
+        size_t len = k.size(), depth = 0;
+        Node * n = _root;
+
+        while (n) {
+            if (is_leaf(n)) {
+                Leaf * l = leaf(n);
+                return leaf_matches(l, key, len) ? &l->value : NULL;
+            }
+            if (n->prefix_len) {
+                if (check_prefix(n, key, len, depth) != min(n->prefix_len, max_prefix)) {
+                    return NULL;
+                }
+                depth += n->prefix_len;
+            }
+            if (depth >= len) {
+                return NULL;
+            }
+            Node ** child = find_child(n, key[depth]);
+            n = child ? *child : NULL;
+            ++depth;
+        }
+        return NULL;
+    }
+
+    // returns whether k is new
+    template <class Key>
+    bool set(const Key & k, V v) {
+        if (!insert(&_root, k.data(), k.size(), 0, v)) {
+            return false;
+        }
+        ++_size;
+        return true;
+    }
+
+    template <class Key>
+    bool del(const Key & k) {
+        if (!erase(&_root, k.data(), k.size(), 0)) {
+            return false;
+        }
+        --_size;
+        return true;
+    }
+
+    // how many keys are in [lo, hi)
+    template <class Key>
+    size_t count(const Key & lo, const Key & hi) {
+        Counter counter = { hi.data(), hi.size(), 0 };
+        scan(_root, 0, lo.data(), lo.size(), true, counter);
+        return counter.found;
+    }
+
+    /*
+        Calls f(key, len, value) for every entry from the first key >= lo,
+        in order, until f returns false.
+    */
+    template <class Key, class F>
+    void scan(const Key & lo, F & f) {
+        scan(_root, 0, lo.data(), lo.size(), true, f);
+    }
+
+private:
+    enum { node4 = 1, node16, node48, node256 };
+
+    static const size_t max_prefix = 8;
+
+    struct Node {
+        uint8_t type;
+        uint16_t count; // children
+        uint32_t prefix_len; // the whole prefix, only the first max_prefix bytes are kept
+        unsigned char prefix[max_prefix];
+    };
+
+    struct Node4 : Node {
+        unsigned char keys[4];
+        Node * children[4];
+    };
+
+    struct Node16 : Node {
+        unsigned char keys[16];
+        Node * children[16];
+    };
+
+    // index[byte] is 1 + the child's position in children, 0 for none
+    struct Node48 : Node {
+        unsigned char index[256];
+        Node * children[48];
+    };
+
+    struct Node256 : Node {
+        Node * children[256];
+    };
+
+    struct Leaf {
+        V value;
+        uint32_t len;
+        unsigned char key[1];
+    };
+
+    struct Counter {
+        const unsigned char * hi;
+        size_t hi_len;
+        size_t found;
+
+        bool operator()(const unsigned char * key, size_t len, V & value) {
+            if (compare(key, len, hi, hi_len) >= 0) {
+                return false;
+            }
+            ++found;
+            return true;
+        }
+    };
+
+    inline static size_t min(size_t a, size_t b) {
+        return a < b ? a : b;
+    }
+
+    inline static bool is_leaf(const Node * n) {
+        return (uintptr_t)n & 1;
+    }
+
+    inline static Leaf * leaf(const Node * n) {
+        return (Leaf *)((uintptr_t)n & ~(uintptr_t)1);
+    }
+
+    inline static Node * tag(Leaf * l) {
+        return (Node *)((uintptr_t)l | 1);
+    }
+
+    static int compare(const unsigned char * a, size_t a_len, const unsigned char * b, size_t b_len) {
+        int c = memcmp(a, b, min(a_len, b_len));
+        return c ? c : (a_len > b_len) - (a_len < b_len);
+    }
+
+    inline static bool leaf_matches(const Leaf * l, const unsigned char * key, size_t len) {
+        return l->len == len && !memcmp(l->key, key, len);
+    }
+
+    template <class T>
+    static T * alloc_node(int type) {
+        T * n = (T *)calloc(1, sizeof(T));
+        if (!n) {
+            throw std::bad_alloc();
+        }
+        n->type = type;
+        return n;
+    }
+
+    static Node * make_leaf(const unsigned char * key, size_t len, V & v) {
+        Leaf * l = (Leaf *)malloc(sizeof(Leaf) + len);
+        if (!l) {
+            throw std::bad_alloc();
+        }
+        new (&l->value) V(std::move(v));
+        l->len = len;
+        memcpy(l->key, key, len);
+        return tag(l);
+    }
+
+    static void free_leaf(Node * n) {
+        leaf(n)->value.~V();
+        free(leaf(n));
+    }
+
+    static void destroy(Node * n) {
+        if (!n) {
+            return;
+        }
+        if (is_leaf(n)) {
+            free_leaf(n);
+            return;
+        }
+        switch (n->type) {
+        case node4:
+            for (int i = 0; i < n->count; ++i) {
+                destroy(((Node4 *)n)->children[i]);
+            }
+            break;
+        case node16:
+            for (int i = 0; i < n->count; ++i) {
+                destroy(((Node16 *)n)->children[i]);
+            }
+            break;
+        case node48:
+            for (int i = 0; i < 48; ++i) {
+                destroy(((Node48 *)n)->children[i]);
+            }
+            break;
+        case node256:
+            for (int i = 0; i < 256; ++i) {
+                destroy(((Node256 *)n)->children[i]);
+            }
+            break;
+        }
+        free(n);
+    }
+
+    static Node ** find_child(Node * n, unsigned char c) {
+        switch (n->type) {
+        case node4: {
+            Node4 * p = (Node4 *)n;
+            for (int i = 0; i < n->count; ++i) {
+                if (p->keys[i] == c) {
+                    return &p->children[i];
+                }
+            }
+            return NULL;
+        }
+        case node16: {
+            Node16 * p = (Node16 *)n;
+#ifdef __SSE2__
+            __m128i cmp = _mm_cmpeq_epi8(_mm_set1_epi8(c), _mm_loadu_si128((const __m128i *)p->keys));
+            unsigned m = _mm_movemask_epi8(cmp) & ((1u << n->count) - 1);
+            return m ? &p->children[__builtin_ctz(m)] : NULL;
+#else
+            for (int i = 0; i < n->count; ++i) {
+                if (p->keys[i] == c) {
+                    return &p->children[i];
+                }
+            }
+            return NULL;
+#endif
+        }
+        case node48: {
+            Node48 * p = (Node48 *)n;
+            return p->index[c] ? &p->children[p->index[c] - 1] : NULL;
+        }
+        default: {
+            Node256 * p = (Node256 *)n;
+            return p->children[c] ? &p->children[c] : NULL;
+        }
+        }
+    }
+
+    // the leftmost leaf under n
+    static Leaf * minimum(Node * n) {
+        while (!is_leaf(n)) {
+            switch (n->type) {
+            case node4:
+                n = ((Node4 *)n)->children[0];
+                break;
+            case node16:
+                n = ((Node16 *)n)->children[0];
+                break;
+            case node48: {
+                Node48 * p = (Node48 *)n;
+                int i = 0;
+                while (!p->index[i]) {
+                    ++i;
+                }
+                n = p->children[p->index[i] - 1];
+                break;
+            }
+            default: {
+                Node256 * p = (Node256 *)n;
+                int i = 0;
+                while (!p->children[i]) {
+                    ++i;
+                }
+                n = p->children[i];
+                break;
+            }
+            }
+        }
+        return leaf(n);
+    }
+
+    // how many of the kept prefix bytes match the key from depth
+    static size_t check_prefix(const Node * n, const unsigned char * key, size_t len, size_t depth) {
+        size_t end = min(min(n->prefix_len, max_prefix), len - depth);
+        size_t i = 0;
+        while (i < end && n->prefix[i] == key[depth + i]) {
+            ++i;
+        }
+        return i;
+    }
+
+    // how many of the whole prefix's bytes match the key from depth, the ones not kept from a leaf
+    static size_t prefix_mismatch(Node * n, const unsigned char * key, size_t len, size_t depth) {
+        size_t i = check_prefix(n, key, len, depth);
+        if (i < max_prefix || n->prefix_len <= max_prefix) {
+            return i;
+        }
+        Leaf * l = minimum(n);
+        size_t end = min(min(l->len, len) - depth, n->prefix_len);
+        while (i < end && l->key[depth + i] == key[depth + i]) {
+            ++i;
+        }
+        return i;
+    }
+
+    static void copy_header(Node * to, const Node * from) {
+        to->count = from->count;
+        to->prefix_len = from->prefix_len;
+        memcpy(to->prefix, from->prefix, min(from->prefix_len, max_prefix));
+    }
+
+    // adds child under byte c to n, replacing n (in *ref) with a bigger node if it's full
+    static void add_child(Node * n, Node ** ref, unsigned char c, Node * child) {
+        switch (n->type) {
+        case node4: {
+            Node4 * p = (Node4 *)n;
+            if (n->count < 4) {
+                int i = 0;
+                while (i < n->count && p->keys[i] < c) {
+                    ++i;
+                }
+                memmove(p->keys + i + 1, p->keys + i, n->count - i);
+                memmove(p->children + i + 1, p->children + i, (n->count - i) * sizeof(Node *));
+                p->keys[i] = c;
+                p->children[i] = child;
+                ++n->count;
+                return;
+            }
+            Node16 * bigger = alloc_node<Node16>(node16);
+            copy_header(bigger, n);
+            memcpy(bigger->keys, p->keys, 4);
+            memcpy(bigger->children, p->children, 4 * sizeof(Node *));
+            *ref = bigger;
+            free(n);
+            add_child(bigger, ref, c, child);
+            return;
+        }
+        case node16: {
+            Node16 * p = (Node16 *)n;
+            if (n->count < 16) {
+                int i = 0;
+                while (i < n->count && p->keys[i] < c) {
+                    ++i;
+                }
+                memmove(p->keys + i + 1, p->keys + i, n->count - i);
+                memmove(p->children + i + 1, p->children + i, (n->count - i) * sizeof(Node *));
+                p->keys[i] = c;
+                p->children[i] = child;
+                ++n->count;
+                return;
+            }
+            Node48 * bigger = alloc_node<Node48>(node48);
+            copy_header(bigger, n);
+            for (int i = 0; i < 16; ++i) {
+                bigger->children[i] = p->children[i];
+                bigger->index[p->keys[i]] = i + 1;
+            }
+            *ref = bigger;
+            free(n);
+            add_child(bigger, ref, c, child);
+            return;
+        }
+        case node48: {
+            Node48 * p = (Node48 *)n;
+            if (n->count < 48) {
+                int i = 0;
+                while (p->children[i]) {
+                    ++i;
+                }
+                p->children[i] = child;
+                p->index[c] = i + 1;
+                ++n->count;
+                return;
+            }
+            Node256 * bigger = alloc_node<Node256>(node256);
+            copy_header(bigger, n);
+            for (int b = 0; b < 256; ++b) {
+                if (p->index[b]) {
+                    bigger->children[b] = p->children[p->index[b] - 1];
+                }
+            }
+            *ref = bigger;
+            free(n);
+            add_child(bigger, ref, c, child);
+            return;
+        }
+        default:
+            ((Node256 *)n)->children[c] = child;
+            ++n->count;
+            return;
+        }
+    }
+
+    // removes the child in slot (under byte c) from n, replacing n (in *ref) with a smaller node once it's sparse enough
+    static void remove_child(Node * n, Node ** ref, unsigned char c, Node ** slot) {
+        switch (n->type) {
+        case node4: {
+            Node4 * p = (Node4 *)n;
+            int i = slot - p->children;
+            memmove(p->keys + i, p->keys + i + 1, n->count - i - 1);
+            memmove(p->children + i, p->children + i + 1, (n->count - i - 1) * sizeof(Node *));
+            if (--n->count > 1) {
+                return;
+            }
+            // one child left, so this node goes and its prefix and key byte go in front of the child's
+            Node * child = p->children[0];
+            if (!is_leaf(child)) {
+                size_t prefix = n->prefix_len;
+                if (prefix < max_prefix) {
+                    n->prefix[prefix++] = p->keys[0];
+                }
+                if (prefix < max_prefix) {
+                    size_t sub = min(child->prefix_len, max_prefix - prefix);
+                    memcpy(n->prefix + prefix, child->prefix, sub);
+                    prefix += sub;
+                }
+                memcpy(child->prefix, n->prefix, min(prefix, max_prefix));
+                child->prefix_len += n->prefix_len + 1;
+            }
+            *ref = child;
+            free(n);
+            return;
+        }
+        case node16: {
+            Node16 * p = (Node16 *)n;
+            int i = slot - p->children;
+            memmove(p->keys + i, p->keys + i + 1, n->count - i - 1);
+            memmove(p->children + i, p->children + i + 1, (n->count - i - 1) * sizeof(Node *));
+            if (--n->count > 3) {
+                return;
+            }
+            Node4 * smaller = alloc_node<Node4>(node4);
+            copy_header(smaller, n);
+            memcpy(smaller->keys, p->keys, 4);
+            memcpy(smaller->children, p->children, 4 * sizeof(Node *));
+            *ref = smaller;
+            free(n);
+            return;
+        }
+        case node48: {
+            Node48 * p = (Node48 *)n;
+            p->children[p->index[c] - 1] = NULL;
+            p->index[c] = 0;
+            if (--n->count > 12) {
+                return;
+            }
+            Node16 * smaller = alloc_node<Node16>(node16);
+            copy_header(smaller, n);
+            int j = 0;
+            for (int b = 0; b < 256; ++b) {
+                if (p->index[b]) {
+                    smaller->keys[j] = b;
+                    smaller->children[j++] = p->children[p->index[b] - 1];
+                }
+            }
+            *ref = smaller;
+            free(n);
+            return;
+        }
+        default: {
+            Node256 * p = (Node256 *)n;
+            p->children[c] = NULL;
+            if (--n->count > 37) {
+                return;
+            }
+            Node48 * smaller = alloc_node<Node48>(node48);
+            copy_header(smaller, n);
+            int j = 0;
+            for (int b = 0; b < 256; ++b) {
+                if (p->children[b]) {
+                    smaller->children[j] = p->children[b];
+                    smaller->index[b] = ++j;
+                }
+            }
+            *ref = smaller;
+            free(n);
+            return;
+        }
+        }
+    }
+
+    static bool insert(Node ** ref, const unsigned char * key, size_t len, size_t depth, V & v) {
+        Node * n = *ref;
+        if (!n) {
+            *ref = make_leaf(key, len, v);
+            return true;
+        }
+
+        if (is_leaf(n)) {
+            Leaf * l = leaf(n);
+            if (leaf_matches(l, key, len)) {
+                l->value = std::move(v);
+                return false;
+            }
+            // two leaves under a new node, with whatever they share past depth as its prefix
+            size_t shared = 0, end = min(l->len, len);
+            while (depth + shared < end && l->key[depth + shared] == key[depth + shared]) {
+                ++shared;
+            }
+            Node4 * split = alloc_node<Node4>(node4);
+            split->prefix_len = shared;
+            memcpy(split->prefix, key + depth, min(shared, max_prefix));
+            *ref = split;
+            add_child(split, ref, l->key[depth + shared], n);
+            add_child(split, ref, key[depth + shared], make_leaf(key, len, v));
+            return true;
+        }
+
+        if (n->prefix_len) {
+            size_t match = prefix_mismatch(n, key, len, depth);
+            if (match < n->prefix_len) {
+                // the key leaves the prefix part way, so split it there
+                Node4 * split = alloc_node<Node4>(node4);
+                split->prefix_len = match;
+                memcpy(split->prefix, n->prefix, min(match, max_prefix));
+                *ref = split;
+                if (n->prefix_len <= max_prefix) {
+                    add_child(split, ref, n->prefix[match], n);
+                    n->prefix_len -= match + 1;
+                    memmove(n->prefix, n->prefix + match + 1, min(n->prefix_len, max_prefix));
+                } else {
+                    // the bytes past max_prefix are only in the leaves
+                    Leaf * l = minimum(n);
+                    add_child(split, ref, l->key[depth + match], n);
+                    n->prefix_len -= match + 1;
+                    memcpy(n->prefix, l->key + depth + match + 1, min(n->prefix_len, max_prefix));
+                }
+                add_child(split, ref, key[depth + match], make_leaf(key, len, v));
+                return true;
+            }
+            depth += n->prefix_len;
+        }
+
+        Node ** child = find_child(n, key[depth]);
+        if (child) {
+            return insert(child, key, len, depth + 1, v);
+        }
+        add_child(n, ref, key[depth], make_leaf(key, len, v));
+        return true;
+    }
+
+    static bool erase(Node ** ref, const unsigned char * key, size_t len, size_t depth) {
+        Node * n = *ref;
+        if (!n) {
+            return false;
+        }
+        if (is_leaf(n)) {
+            if (!leaf_matches(leaf(n), key, len)) {
+                return false;
+            }
+            free_leaf(n);
+            *ref = NULL;
+            return true;
+        }
+
+        if (n->prefix_len) {
+            if (check_prefix(n, key, len, depth) != min(n->prefix_len, max_prefix)) {
+                return false;
+            }
+            depth += n->prefix_len;
+        }
+        if (depth >= len) {
+            return false;
+        }
+
+        Node ** child = find_child(n, key[depth]);
+        if (!child) {
+            return false;
+        }
+        if (is_leaf(*child)) {
+            if (!leaf_matches(leaf(*child), key, len)) {
+                return false;
+            }
+            free_leaf(*child);
+            remove_child(n, ref, key[depth], child);
+            return true;
+        }
+        return erase(child, key, len, depth + 1);
+    }
+
+    /*
+        Visits the leaves under n in order, skipping those < lo while
+        bounded (n may hold keys on both sides of lo). Returns false once f
+        has.
+    */
+    template <class F>
+    static bool scan(Node * n, size_t depth, const unsigned char * lo, size_t lo_len, bool bounded, F & f) {
+        if (!n) {
+            return true;
+        }
+        if (is_leaf(n)) {
+            Leaf * l = leaf(n);
+            if (bounded && compare(l->key, l->len, lo, lo_len) < 0) {
+                return true;
+            }
+            return f(l->key, l->len, l->value);
+        }
+
+        if (bounded && n->prefix_len) {
+            const unsigned char * prefix = n->prefix_len <= max_prefix ? n->prefix : minimum(n)->key + depth;
+            size_t end = min(n->prefix_len, lo_len - depth);
+            int c = memcmp(prefix, lo + depth, end);
+            if (c < 0) {
+                return true; // all of it is before lo
+            }
+            bounded = !c && end == n->prefix_len; // past lo, or lo ends inside the prefix
+        }
+        depth += n->prefix_len;
+        bounded = bounded && depth < lo_len;
+        unsigned char from = bounded ? lo[depth] : 0;
+
+        switch (n->type) {
+        case node4:
+        case node16: {
+            int count = n->count;
+            unsigned char * keys = n->type == node4 ? ((Node4 *)n)->keys : ((Node16 *)n)->keys;
+            Node ** children = n->type == node4 ? ((Node4 *)n)->children : ((Node16 *)n)->children;
+            for (int i = 0; i < count; ++i) {
+                if (keys[i] >= from && !scan(children[i], depth + 1, lo, lo_len, bounded && keys[i] == from, f)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        case node48: {
+            Node48 * p = (Node48 *)n;
+            for (int b = from; b < 256; ++b) {
+                if (p->index[b] && !scan(p->children[p->index[b] - 1], depth + 1, lo, lo_len, bounded && b == from, f)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        default: {
+            Node256 * p = (Node256 *)n;
+            for (int b = from; b < 256; ++b) {
+                if (p->children[b] && !scan(p->children[b], depth + 1, lo, lo_len, bounded && b == from, f)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        }
+    }
+
+    Node * _root;
+    size_t _size;
+};
+
+
+// int64_t keys as 8 big endian bytes with the sign bit flipped, so that byte order is numeric order
+struct ArtIntKey {
+    unsigned char bytes[8];
+
+    explicit ArtIntKey(int64_t k) {
+        uint64_t u = (uint64_t)k ^ ((uint64_t)1 << 63);
+        for (int i = 0; i < 8; ++i) {
+            bytes[i] = u >> (56 - 8 * i);
+        }
+    }
+
+    const unsigned char * data() const {
+        return bytes;
+    }
+
+    size_t size() const {
+        return 8;
+    }
+};
+
+
+// NUL terminated keys with the NUL, so no key is a prefix of another
+struct ArtStringKey {
+    const char * s;
+    size_t len;
+
+    explicit ArtStringKey(const char * s): s(s), len(strlen(s) + 1) {
+    }
+
+    const unsigned char * data() const {
+        return (const unsigned char *)s;
+    }
+
+    size_t size() const {
+        return len;
+    }
+};
+
+
+typedef AdaptiveRadixTree<int64_t> hash_t;
+typedef AdaptiveRadixTree<int64_t> str_hash_t;
+#define SETUP hash_t hash; str_hash_t str_hash;
+#define INSERT_INT_INTO_HASH(key, value) hash.set(ArtIntKey(key), value)
+#define LOOKUP_INT_IN_HASH(key) hash.get(ArtIntKey(key)) != NULL
+#define DELETE_INT_FROM_HASH(key) hash.del(ArtIntKey(key))
+#define RANGE_COUNT_INT_IN_HASH(lo, hi) hash.count(ArtIntKey(lo), ArtIntKey(hi))
+#define INSERT_STR_INTO_HASH(key, value) str_hash.set(ArtStringKey(key), value)
+#define LOOKUP_STR_IN_HASH(key) str_hash.get(ArtStringKey(key)) != NULL
+#define DELETE_STR_FROM_HASH(key) str_hash.del(ArtStringKey(key))
+#include "template.c"
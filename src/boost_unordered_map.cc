@@ -3,6 +3,7 @@
 typedef boost::unordered_map<int64_t, int64_t> hash_t;
 typedef boost::unordered_map<const char *, int64_t> str_hash_t;
 #define SETUP hash_t hash; str_hash_t str_hash;
+#define SETUP_RESERVED(n) SETUP hash.reserve(n);
 #define INSERT_INT_INTO_HASH(key, value) hash.insert(hash_t::value_type(key, value))
 #define DELETE_INT_FROM_HASH(key) hash.erase(key)
 #define INSERT_STR_INTO_HASH(key, value) str_hash.insert(str_hash_t::value_type(key, value))
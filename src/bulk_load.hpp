@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef> // size_t
+#include <thread>
+#include <vector>
+
+
+/*
+    The radix partitioning behind Custom::bulk_load and HashTable::bulk_load.
+
+    The table's buckets are split into 2 ** bits ranges of equal size, and
+    the input is grouped by the range its home bucket falls in (the high
+    bits of the bucket), so that threads can fill ranges side by side
+    without sharing a slot. An entry that probes past the end of its range
+    is handed back by the table and placed afterwards, on its own.
+*/
+struct BulkPartitions {
+    std::vector<size_t> hashes; // hashes[i], the hash of input i
+    std::vector<size_t> order; // the inputs, grouped by range
+    std::vector<size_t> starts; // range p is order[starts[p]] .. order[starts[p + 1] - 1]
+};
+
+// runs f(0) .. f(threads - 1) at once, f(0) on the calling thread
+template <class F>
+void bulk_parallel(size_t threads, F f) {
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < threads; ++t) {
+        workers.push_back(std::thread(f, t));
+    }
+    f(0);
+    for (size_t t = 0; t < workers.size(); ++t) {
+        workers[t].join();
+    }
+}
+
+// fills out for n inputs, hash_of(i) being the hash of input i and (hash & mask) >> shift its range
+template <class HashOf>
+void bulk_partition(size_t n, size_t mask, unsigned shift, size_t ranges, size_t threads,
+                    HashOf hash_of, BulkPartitions & out) {
+    std::vector<size_t> counts(threads * ranges); // counts[t * ranges + p], inputs of thread t in range p
+
+    out.hashes.resize(n);
+    out.order.resize(n);
+    out.starts.assign(ranges + 1, 0);
+
+    // hash and count, each thread taking a slice of the input
+    bulk_parallel(threads, [&](size_t t) {
+        size_t * count = &counts[t * ranges];
+        for (size_t i = n * t / threads, e = n * (t + 1) / threads; i < e; ++i) {
+            size_t h = hash_of(i);
+            out.hashes[i] = h;
+            ++count[(h & mask) >> shift];
+        }
+    });
+
+    // where each thread's inputs of each range go, ranges in order and threads in order within a range
+    size_t offset = 0;
+    for (size_t p = 0; p < ranges; ++p) {
+        out.starts[p] = offset;
+        for (size_t t = 0; t < threads; ++t) {
+            size_t c = counts[t * ranges + p];
+            counts[t * ranges + p] = offset;
+            offset += c;
+        }
+    }
+    out.starts[ranges] = offset;
+
+    bulk_parallel(threads, [&](size_t t) {
+        size_t * next = &counts[t * ranges];
+        for (size_t i = n * t / threads, e = n * (t + 1) / threads; i < e; ++i) {
+            out.order[next[(out.hashes[i] & mask) >> shift]++] = i;
+        }
+    });
+}
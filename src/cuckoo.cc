@@ -0,0 +1,352 @@
+#include "hash_policy.hpp"
+#include "table_stats.h"
+
+#include <utility> // swap, pair
+#include <functional> // hash
+#include <cstdlib> // posix_memalign, free
+#include <new> // bad_alloc
+#include <limits>
+
+
+/*
+    Bucketized cuckoo hashing: every key has two buckets of four slots, and
+    is in one of them or in a small stash. A bucket is a cache line (for
+    8 byte keys and values), so a lookup reads at most two lines of the
+    table, and both are requested before either is searched.
+
+    Inserting into two full buckets looks for the nearest bucket with a free
+    slot by breadth first search over the alternate buckets of the keys in
+    the way, then moves each key on the path one step, last first. When no
+    path of max_nodes buckets turns up, the entry goes into the stash, and
+    the table only grows once that's full too (or at max_load percent).
+
+    Like google's dense_hash_map there's an empty key, which marks the
+    free slots and can't itself be stored.
+*/
+template <class K, class V, class H = typename key_hash<K>::type, class P = std::equal_to<K> >
+class Cuckoo {
+public:
+    typedef std::pair<K, V> value_type;
+
+    static const size_t bucket_slots = 4;
+    static const size_t max_load = 95; // percent of the slots
+    static const size_t stash_slots = 8;
+    static const size_t max_nodes = 512; // buckets a displacement search visits
+
+    explicit Cuckoo(const K & empty_key):
+        _empty(empty_key),
+        _bucket_count(2),
+        _size(0),
+        _stash_size(0),
+        _rehashes(0) {
+        alloc();
+    }
+
+    ~Cuckoo() {
+        release(_buckets, _bucket_count);
+    }
+
+    size_t size() const {
+        return _size;
+    }
+
+    size_t capacity() const {
+        return _bucket_count * bucket_slots;
+    }
+
+    V * get(const K & k) {
+        size_t h = hash_key(k);
+        Bucket & b1 = _buckets[bucket1(h)];
+        Bucket & b2 = _buckets[bucket2(h)];
+        __builtin_prefetch(&b2);
+
+        for (size_t i = 0; i < bucket_slots; ++i) {
+            if (pred(b1.kv[i].first, k)) {
+                return &b1.kv[i].second;
+            }
+        }
+        for (size_t i = 0; i < bucket_slots; ++i) {
+            if (pred(b2.kv[i].first, k)) {
+                return &b2.kv[i].second;
+            }
+        }
+        return _stash_size ? stash_get(k) : NULL;
+    }
+
+    // returns whether k is new
+    bool set(const K & k, V v) {
+        V * found = get(k);
+        if (found) {
+            *found = std::move(v);
+            return false;
+        }
+
+        if (_size >= _grow) {
+            rehash(_bucket_count * 2);
+        }
+        value_type kv(k, std::move(v));
+        while (!insert(kv)) {
+            rehash(_bucket_count * 2);
+        }
+        ++_size;
+        return true;
+    }
+
+    bool del(const K & k) {
+        size_t h = hash_key(k);
+        Bucket * candidates[2] = { &_buckets[bucket1(h)], &_buckets[bucket2(h)] };
+
+        for (int c = 0; c < 2; ++c) {
+            for (size_t i = 0; i < bucket_slots; ++i) {
+                if (pred(candidates[c]->kv[i].first, k)) {
+                    candidates[c]->kv[i] = value_type(_empty, V());
+                    --_size;
+                    return true;
+                }
+            }
+        }
+        for (size_t i = 0; i < _stash_size; ++i) {
+            if (pred(_stash[i].first, k)) {
+                std::swap(_stash[i], _stash[--_stash_size]);
+                _stash[_stash_size] = value_type(_empty, V());
+                --_size;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // grows the table so that n entries fit without growing again
+    void reserve(size_t n) {
+        size_t count = _bucket_count;
+        while (count * bucket_slots * max_load / 100 <= n) {
+            count *= 2;
+        }
+        if (count > _bucket_count) {
+            rehash(count);
+        }
+    }
+
+    double load_factor() const {
+        return 1.0 * _size / capacity();
+    }
+
+    // fills in stats (see table_stats.h), the probe being 0 in the first bucket, 1 in the second and 2 in the stash
+    void stats(table_stats & s) const {
+        table_stats_reset(&s);
+        s.size = _size;
+        s.capacity = capacity();
+        s.payload_bytes = sizeof(Bucket) * _bucket_count + sizeof(_stash);
+        s.rehashes = _rehashes;
+        for (size_t b = 0; b < _bucket_count; ++b) {
+            for (size_t i = 0; i < bucket_slots; ++i) {
+                const K & k = _buckets[b].kv[i].first;
+                if (!is_empty(k)) {
+                    table_stats_probe(&s, b != bucket1(hash_key(k)));
+                }
+            }
+        }
+        for (size_t i = 0; i < _stash_size; ++i) {
+            table_stats_probe(&s, 2);
+        }
+    }
+
+private:
+    struct alignas(64) Bucket {
+        value_type kv[bucket_slots];
+    };
+
+    // a bucket the displacement search reached, by moving slot of parent's bucket here
+    struct Node {
+        size_t bucket;
+        int parent;
+        int slot;
+    };
+
+    inline static size_t hash_key(const K & k) {
+        return H()(k);
+    }
+
+    inline static bool pred(const K & k1, const K & k2) {
+        return P()(k1, k2);
+    }
+
+    inline bool is_empty(const K & k) const {
+        return pred(k, _empty);
+    }
+
+    inline size_t bucket1(size_t h) const {
+        return h & _mask;
+    }
+
+    // from the other half of the hash, remixed, and never the same as bucket1
+    inline size_t bucket2(size_t h) const {
+        size_t h2 = (h ^ (h >> 29)) * 0xbf58476d1ce4e5b9ull;
+        size_t b = (h2 ^ (h2 >> 32)) & _mask;
+        return b != bucket1(h) ? b : b ^ 1;
+    }
+
+    // the other bucket of the key in slot i of bucket b
+    inline size_t alternate(size_t b, size_t i) const {
+        size_t h = hash_key(_buckets[b].kv[i].first);
+        size_t b1 = bucket1(h);
+        return b == b1 ? bucket2(h) : b1;
+    }
+
+    // a free slot of bucket b, or -1
+    inline int free_slot(size_t b) const {
+        for (size_t i = 0; i < bucket_slots; ++i) {
+            if (is_empty(_buckets[b].kv[i].first)) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    V * stash_get(const K & k) {
+        for (size_t i = 0; i < _stash_size; ++i) {
+            if (pred(_stash[i].first, k)) {
+                return &_stash[i].second;
+            }
+        }
+        return NULL;
+    }
+
+    // puts a key known not to be in the table in a free slot, making one if
+    // it has to; false, with nothing changed, if even the stash is full
+    bool insert(value_type & kv) {
+        size_t h = hash_key(kv.first);
+        Node nodes[max_nodes];
+        int count = 2;
+        nodes[0].bucket = bucket1(h);
+        nodes[1].bucket = bucket2(h);
+        nodes[0].parent = nodes[1].parent = -1;
+
+        for (int n = 0; n < count; ++n) {
+            int slot = free_slot(nodes[n].bucket);
+            if (slot >= 0) {
+                // move everything on the path one step along, from the free slot back
+                for (; nodes[n].parent >= 0; n = nodes[n].parent) {
+                    const Node & from = nodes[nodes[n].parent];
+                    std::swap(_buckets[nodes[n].bucket].kv[slot], _buckets[from.bucket].kv[nodes[n].slot]);
+                    slot = nodes[n].slot;
+                }
+                std::swap(_buckets[nodes[n].bucket].kv[slot], kv);
+                return true;
+            }
+
+            for (size_t i = 0; i < bucket_slots && count < (int)max_nodes; ++i) {
+                size_t b = alternate(nodes[n].bucket, i);
+                // a bucket can't be on its own path twice, its slots would be moved under it
+                int on_path = n;
+                while (on_path >= 0 && nodes[on_path].bucket != b) {
+                    on_path = nodes[on_path].parent;
+                }
+                if (on_path < 0) {
+                    nodes[count].bucket = b;
+                    nodes[count].parent = n;
+                    nodes[count].slot = i;
+                    ++count;
+                }
+            }
+        }
+
+        if (_stash_size < stash_slots) {
+            std::swap(_stash[_stash_size++], kv);
+            return true;
+        }
+        return false;
+    }
+
+    void alloc() {
+        void * buckets;
+        if (posix_memalign(&buckets, alignof(Bucket), sizeof(Bucket) * _bucket_count)) {
+            throw std::bad_alloc();
+        }
+        _buckets = (Bucket *)buckets;
+        for (size_t b = 0; b < _bucket_count; ++b) {
+            for (size_t i = 0; i < bucket_slots; ++i) {
+                new (&_buckets[b].kv[i]) value_type(_empty, V());
+            }
+        }
+        for (size_t i = 0; i < stash_slots; ++i) {
+            _stash[i] = value_type(_empty, V());
+        }
+        _stash_size = 0;
+        _mask = _bucket_count - 1;
+        _grow = capacity() * max_load / 100;
+    }
+
+    static void release(Bucket * buckets, size_t count) {
+        for (size_t b = 0; b < count; ++b) {
+            for (size_t i = 0; i < bucket_slots; ++i) {
+                buckets[b].kv[i].~value_type();
+            }
+        }
+        free(buckets);
+    }
+
+    // moves everything into count buckets, or more if they don't all fit
+    void rehash(size_t count) {
+        Bucket * old = _buckets;
+        size_t old_count = _bucket_count;
+        value_type stash[stash_slots];
+        size_t stash_size = _stash_size;
+        for (size_t i = 0; i < stash_size; ++i) {
+            stash[i] = _stash[i];
+        }
+        ++_rehashes;
+
+        // copied rather than moved, so a failed attempt loses nothing
+        for (bool fits = false; !fits; count *= 2) {
+            _bucket_count = count;
+            alloc();
+            fits = true;
+            for (size_t b = 0; fits && b < old_count; ++b) {
+                for (size_t i = 0; fits && i < bucket_slots; ++i) {
+                    if (!is_empty(old[b].kv[i].first)) {
+                        value_type kv(old[b].kv[i]);
+                        fits = insert(kv);
+                    }
+                }
+            }
+            for (size_t i = 0; fits && i < stash_size; ++i) {
+                value_type kv(stash[i]);
+                fits = insert(kv);
+            }
+            if (!fits) {
+                release(_buckets, _bucket_count);
+            }
+        }
+        release(old, old_count);
+    }
+
+    K _empty; // the key of a free slot
+    Bucket * _buckets;
+    size_t _bucket_count; // 2 ** n
+    size_t _mask;
+    size_t _size; // entries, the stash's included
+    size_t _grow; // when _size reaches _grow, double
+    value_type _stash[stash_slots]; // what didn't fit, _stash[0 .. _stash_size - 1]
+    size_t _stash_size;
+    size_t _rehashes; // for stats()
+};
+
+
+#include <cinttypes>
+#ifndef STRING_HASH
+#define STRING_HASH fnv1a_hash
+#endif
+typedef Cuckoo<int64_t, int64_t> hash_t;
+typedef Cuckoo<const char *, int64_t, STRING_HASH> str_hash_t;
+#define SETUP hash_t hash(std::numeric_limits<int64_t>::min()); str_hash_t str_hash(NULL);
+#define SETUP_RESERVED(n) SETUP hash.reserve(n);
+#define INSERT_INT_INTO_HASH(key, value) hash.set(key, value)
+#define LOOKUP_INT_IN_HASH(key) hash.get(key) != NULL
+#define DELETE_INT_FROM_HASH(key) hash.del(key)
+#define INSERT_STR_INTO_HASH(key, value) str_hash.set(key, value)
+#define LOOKUP_STR_IN_HASH(key) str_hash.get(key) != NULL
+#define DELETE_STR_FROM_HASH(key) str_hash.del(key)
+#define INT_HASH_STATS(s) hash.stats(s)
+#define STR_HASH_STATS(s) str_hash.stats(s)
+#include "template.c"
@@ -1,241 +1,50 @@
-// #include <cinttypes>
-
-#include <utility> // swap, pair
-#include <functional> // hash
-#include <cstdlib> // malloc, realloc, free
-#include <stdexcept> // out_of_range
-#include <strings.h> // bzero
-
-
-template <class K, class V, class H = std::hash<K>, class P = std::equal_to<K> >
-class Custom {
-public:
-    typedef std::pair<K, V> value_type;
-
-    explicit Custom():
-        _capacity(4),
-        _load_factor(90),
-        _size(0) {
-        alloc();
-    }
-
-    ~Custom() {
-        for (size_t i = 0; i < _capacity; ++i) {
-            if (_h[i] != -1) {
-                destruct(_kv[i]);
-            }
-        }
-        free(_h);
-        free(_kv);
-    }
-
-    size_t size() const {
-        return _size;
-    }
-
-    size_t capacity() const {
-        return _capacity;
-    }
-
-    bool empty() const {
-        return !_size;
-    }
-
-    V * get(const K & k) {
-        if (!_size) {
-            return NULL;
-        }
-
-        size_t h = hash_key(k);
-        size_t i = bucket(h);
-        size_t dist = 0;
-
-        while (true) {
-            size_t hash_i = _h[i];
-
-            if (hash_i == h) {
-                value_type & kv = _kv[i];
-                if (keys_equal(k, kv.first)) {
-                    return &_kv[i];
-                }
-            } else if (hash_i == -1 || probe_distance(hash_i, i) < dist) {
-                return NULL;
-            }
-
-            i = (i + 1) & _mask;
-            ++dist;
-        }
-    }
-
-    inline const V * get(const K & k) const {
-        return const_cast<Custom *>(this)->get(k);
-    }
-
-    void set(value_type && kv) {
-        if (_size == _grow) {
-            rehash(_capacity * 2);
-        }
-        _set(hash_key(kv.first), std::move(kv));
-    }
-
-    void del(const K & k) {
-        if (!_size) {
-            return;
-        }
-
-        size_t h = hash_key(k);
-        size_t i = bucket(h);
-        size_t dist = 0;
-
-        while (true) {
-            size_t hash_i = _h[i];
-
-            if (hash_i == h) {
-                value_type & kv = _kv[i];
-                if (keys_equal(k, kv.first)) {
-                    destruct(kv);
-                    _h[i] = -1;
-                    --_size;
-                    break;
-                }
-            } else if (hash_i == -1 || probe_distance(hash_i, i) < dist) {
-                return;
-            }
-
-            i = (i + 1) & _mask;
-            ++dist;
-        }
-
-        if (_size == _shrink) {
-            rehash(_capacity / 2);
-        } else {
-            while (true) {
-                i = (i + 1) & _mask;
-                size_t hash_i = _h[i];
-                if (hash_i == -1 || !probe_distance(hash_i, i)) {
-                    break;
-                }
-                std::swap(_h[i], _h[i - 1]);
-                std::swap(_kv[i], _kv[i - 1]);
-            }
-        }
-    }
-
-    double load_factor() const {
-        return 1.0 * _size / _capacity;
-    }
-
-// private:
-
-    void rehash(size_t new_capacity) {
-        auto old_capacity = _capacity;
-        auto h = _h;
-        auto kv = _kv;
-
-        _capacity = new_capacity;
-        _size = 0;
-        alloc();
-
-        for (size_t i = 0; i < old_capacity; ++i) {
-            if (h[i] != -1) {
-                _set(h[i], std::move(kv[i]));
-            }
-        }
-
-        free(h);
-        free(kv);
-    }
-
-    void alloc() {
-        _h = (size_t *)malloc(sizeof(size_t) * _capacity);
-        _kv = (value_type *)malloc(sizeof(value_type) * _capacity);
-        memset(_h, -1, sizeof(size_t) * _capacity);
-        _grow = _load_factor * _capacity / 100;
-        _shrink = _load_factor * _capacity / 400;
-        _mask = _capacity - 1;
-    }
-
-    void _set(size_t h, value_type && kv) {
-        size_t i = bucket(h);
-        size_t dist = 0;
-
-        while (true) {
-            size_t hash_i = _h[i];
-
-            if (hash_i == h) {
-                value_type & kv_i = _kv[i];
-                if (keys_equal(kv.first, kv_i.first)) {
-                    kv_i.second = std::move(kv.second);
-                    return;
-                }
-            } else if (hash_i == -1) {
-                construct(_kv[i], std::move(kv));
-                _h[i] = h;
-                ++_size;
-                return;
-            } else {
-                size_t dist_i = probe_distance(hash_i, i);
-                if (dist_i < dist) {
-                    std::swap(_h[i], h);
-                    std::swap(_kv[i], kv);
-                    dist = dist_i;
-                }
-            }
-
-            i = (i + 1) & _mask;
-            ++dist;
-        }
-    }
-
-    inline static size_t hash_key(const K & k) {
-        static H h;
-        size_t hk = h(k);
-        return hk == -1 ? 0 : hk;
-    }
-
-    inline size_t bucket(size_t h) const {
-        return h & _mask;
-    }
-
-    inline size_t probe_distance(size_t h, size_t i) const {
-        return (i + _capacity - bucket(h)) & _mask;
-    }
-
-    inline static bool keys_equal(const K & k1, const K & k2) {
-        static P p;
-        return p(k1, k2);
-    }
-
-    inline static void construct(value_type & t, value_type && v) {
-        new (&t) value_type(std::move(v));
-    }
-
-    inline static void destruct(value_type & v) {
-        v.~value_type();
-    }
-
-    size_t * __restrict _h; // hashes (0 is empty)
-    value_type * __restrict _kv; // key value pairs
-    size_t _capacity; // length of arrays
-    size_t _size; // number of items stored
-    size_t _load_factor; // maximum load factor before growing, /4 for minimum before shrinking
-    size_t _grow; // when _size >= _grow, _capcity *= 2
-    size_t _shrink; // when _size < _shrink, _capacity /= 2
-    size_t _mask; // used instead of % _capacity for speed
-};
+#include "custom.hpp"
 
 
 // using namespace std;
 #include <cinttypes>
-typedef Custom<int64_t, int64_t> hash_t;
-typedef Custom<const char *, int64_t> str_hash_t;
+#include "hash_policy.hpp"
+#ifndef STRING_HASH
+#define STRING_HASH fnv1a_hash
+#endif
+#ifndef INT_HASH
+#define INT_HASH fibonacci_hash
+#endif
+#ifdef COMPACT_METADATA
+typedef CompactMetadata<COMPACT_METADATA> metadata_t;
+#else
+typedef FullHashMetadata metadata_t;
+#endif
+typedef Custom<int64_t, int64_t, INT_HASH, std::equal_to<int64_t>, metadata_t> hash_t;
+#ifdef INLINE_STRING_KEYS
+typedef StringCustom<int64_t, STRING_HASH> str_hash_t;
+#define INSERT_STR_INTO_HASH(key, value) str_hash.set(key, value)
+#define INSERT_STR_LEN_INTO_HASH(key, len, value) str_hash.set(key, len, value)
+#define LOOKUP_STR_LEN_IN_HASH(key, len) str_hash.get(key, len) != NULL
+#define DELETE_STR_LEN_FROM_HASH(key, len) str_hash.del(key, len)
+#else
+typedef Custom<const char *, int64_t, STRING_HASH, std::equal_to<const char *>, metadata_t> str_hash_t;
+#define INSERT_STR_INTO_HASH(key, value) str_hash.set(std::make_pair(key, value))
+#endif
+#ifdef INCREMENTAL_REHASH
+#define SETUP hash_t hash; str_hash_t str_hash; \
+    hash.set_incremental_rehash(INCREMENTAL_REHASH); str_hash.set_incremental_rehash(INCREMENTAL_REHASH);
+#else
 #define SETUP hash_t hash; str_hash_t str_hash;
+#endif
+#define SETUP_RESERVED(n) SETUP hash.reserve(n);
 #define INSERT_INT_INTO_HASH(key, value) hash.set(std::make_pair(key, value))
 #define LOOKUP_INT_IN_HASH(key) hash.get(key) != NULL
+#define LOOKUP_INT_BATCH_IN_HASH(keys, n) hash.contains_many(keys, n)
+#define BULK_LOAD_INT_INTO_HASH(keys, values, n, threads) hash.bulk_load(keys, values, n, threads)
 #define DELETE_INT_FROM_HASH(key) hash.del(key)
-#define INSERT_STR_INTO_HASH(key, value) str_hash.set(std::make_pair(key, value))
+#define SAVE_INT_HASH(path) hash.save(path)
+#define ATTACH_INT_HASH(path) hash.attach(path)
 #define LOOKUP_STR_IN_HASH(key) str_hash.get(key) != NULL
+#define LOOKUP_STR_BATCH_IN_HASH(keys, n) str_hash.contains_many(keys, n)
 #define DELETE_STR_FROM_HASH(key) str_hash.del(key)
+#define INT_HASH_STATS(s) hash.stats(s)
+#define STR_HASH_STATS(s) str_hash.stats(s)
 
 #if 1
 #include "template.c"
@@ -249,8 +58,8 @@ using namespace std;
 
 void dump(const hash_t & h) {
     for (size_t i = 0; i < h._capacity; ++i) {
-        if (h._h[i] != -1) {
-            cout << h._h[i] << ':' << h.probe_distance(h._h[i], i) << ' ';
+        if (!hash_t::metadata_type::empty(h._h[i])) {
+            cout << h._h[i] << ':' << h.distance(i) << ' ';
         } else {
             cout << ". ";
         }
@@ -0,0 +1,785 @@
+#pragma once
+
+#include <utility> // swap, pair
+#include <functional> // hash
+#include <cstdlib> // malloc, realloc, free
+#include <stdexcept> // out_of_range
+#include <cstring> // memset, strlen
+#include <type_traits> // is_trivially_copyable, is_pointer
+
+#include "bulk_load.hpp"
+#include "hash_policy.hpp"
+#include "slot_alloc.h"
+#include "string_key.hpp"
+#include "table_file.hpp"
+#include "table_stats.h"
+
+
+/*
+    What Custom keeps per slot in _h, alongside the key value pairs in _kv.
+
+    empty_byte fills a new array with empty slots. make(h, dist) is what
+    a slot holds for a key with hash h that sits dist slots from its home
+    bucket, so a lookup compares slots against make(h, dist). with_distance
+    moves a slot's metadata to another distance. distance() is the stored
+    distance, or saturated when it has to be worked out from the key.
+*/
+
+// the full hash, so rehashing never touches the keys (-1 is empty)
+struct FullHashMetadata {
+    typedef size_t type;
+
+    static const int empty_byte = 0xff;
+    static const bool stores_hash = true;
+    static const size_t saturated = (size_t)-1; // never, the distance always fits
+
+    static bool empty(type m) {
+        return m == (type)-1;
+    }
+
+    static type make(size_t h, size_t dist) {
+        return h;
+    }
+
+    static type with_distance(type m, size_t dist) {
+        return m;
+    }
+
+    static size_t distance(type m, size_t i, size_t mask) {
+        return (i - m) & mask;
+    }
+
+    static size_t hash(type m) {
+        return m;
+    }
+};
+
+
+/*
+    The probe distance in the low byte (0 is empty, distances of 254 and up
+    saturate) and a fingerprint of the hash in the rest of T: 2 bytes a slot
+    with uint16_t, 4 with uint32_t, instead of 8. Rehashing has to hash the
+    keys again.
+*/
+template <class T>
+struct CompactMetadata {
+    typedef T type;
+
+    static const int empty_byte = 0;
+    static const bool stores_hash = false;
+    static const size_t saturated = 254;
+
+    static bool empty(type m) {
+        return !m;
+    }
+
+    static type make(size_t h, size_t dist) {
+        // the high bits of a mixed hash, std::hash<int64_t> is the identity
+        static const int fingerprint_bits = sizeof(T) * 8 - 8;
+        type fingerprint = (type)((h * 0x9E3779B97F4A7C15ull) >> (64 - fingerprint_bits)) << 8;
+        return with_distance(fingerprint, dist);
+    }
+
+    static type with_distance(type m, size_t dist) {
+        return (type)((m & ~(type)0xff) | ((dist < saturated ? dist : saturated) + 1));
+    }
+
+    static size_t distance(type m, size_t i, size_t mask) {
+        return (m & 0xff) - 1;
+    }
+
+    static size_t hash(type m) {
+        return 0;
+    }
+};
+
+
+template <class K, class V, class H = typename key_hash<K>::type, class P = std::equal_to<K>, class M = FullHashMetadata>
+class Custom {
+public:
+    typedef std::pair<K, V> value_type;
+    typedef M metadata_type;
+    typedef typename M::type meta_t;
+
+    explicit Custom():
+        _capacity(4),
+        _load_factor(90),
+        _size(0),
+        _old(NULL),
+        _rehash_step(0),
+        _rehashes(0) {
+        _file.map = NULL;
+        _file.size = 0;
+        alloc();
+    }
+
+    ~Custom() {
+        destroy();
+    }
+
+    size_t size() const {
+        return _old ? _size + _old->_size : _size;
+    }
+
+    size_t capacity() const {
+        return _capacity;
+    }
+
+    bool empty() const {
+        return !size();
+    }
+
+    /*
+        With slots > 0, growing keeps the old arrays next to the new ones and
+        every set or del moves the entries of up to that many old slots
+        across, instead of moving everything at once. Lookups check both
+        until the old arrays are empty. 2 or more finishes each move before
+        the next grow, 0 (the default) moves everything at once.
+    */
+    void set_incremental_rehash(size_t slots) {
+        _rehash_step = slots;
+    }
+
+    // grows the arrays so that n entries fit without growing again
+    void reserve(size_t n) {
+        size_t capacity = _capacity;
+        while (_load_factor * capacity / 100 <= n) {
+            capacity *= 2;
+        }
+        if (capacity > _capacity) {
+            rehash(capacity);
+        }
+    }
+
+    V * get(const K & k) {
+        return get(k, hash_key(k));
+    }
+
+    // h must be hash_key(k), for callers that have already hashed the key
+    V * get(const K & k, size_t h) {
+        if (_old) {
+            V * v = _get(k, h);
+            return v ? v : _old->get(k, h);
+        }
+
+        if (!_size) {
+            return NULL;
+        }
+
+        return _get(k, h);
+    }
+
+    inline const V * get(const K & k) const {
+        return const_cast<Custom *>(this)->get(k);
+    }
+
+    // look up n keys at once, out[i] = get(keys[i]), returns how many were found
+    size_t get_many(const K * keys, size_t n, V ** out) {
+        size_t found = 0;
+
+        if (!size()) {
+            for (size_t i = 0; i < n; ++i) {
+                out[i] = NULL;
+            }
+            return found;
+        }
+
+        // hash a block, prefetch all of its home buckets, then resolve it,
+        // so the cache misses of a block overlap instead of queueing
+        size_t h[batch_block];
+        for (size_t b = 0; b < n; b += batch_block) {
+            size_t e = n - b < batch_block ? n - b : batch_block;
+
+            for (size_t j = 0; j < e; ++j) {
+                h[j] = hash_key(keys[b + j]);
+                size_t i = bucket(h[j]);
+                __builtin_prefetch(&_h[i]);
+                __builtin_prefetch(&_kv[i]);
+            }
+
+            for (size_t j = 0; j < e; ++j) {
+                V * v = _get(keys[b + j], h[j]);
+                if (!v && _old) {
+                    v = _old->get(keys[b + j], h[j]);
+                }
+                found += (out[b + j] = v) != NULL;
+            }
+        }
+
+        return found;
+    }
+
+    // returns how many of the n keys are in the table
+    size_t contains_many(const K * keys, size_t n) {
+        V * out[batch_block];
+        size_t found = 0;
+        for (size_t b = 0; b < n; b += batch_block) {
+            found += get_many(keys + b, n - b < batch_block ? n - b : batch_block, out);
+        }
+        return found;
+    }
+
+    void set(value_type && kv) {
+        size_t h = hash_key(kv.first);
+        set(std::move(kv), h);
+    }
+
+    void set(value_type && kv, size_t h) {
+        if (size() == _grow) {
+            if (_rehash_step) {
+                start_rehash(_capacity * 2);
+            } else {
+                rehash(_capacity * 2);
+            }
+        }
+        if (_old) {
+            migrate(_rehash_step);
+            // the key may not have been moved across yet
+            V * v = _old ? _old->get(kv.first, h) : NULL;
+            if (v) {
+                *v = std::move(kv.second);
+                return;
+            }
+        }
+        _set(h, std::move(kv));
+    }
+
+    void del(const K & k) {
+        del(k, hash_key(k));
+    }
+
+    void del(const K & k, size_t h) {
+        if (_old) {
+            migrate(_rehash_step);
+            if (_old) {
+                _old->del(k, h);
+            }
+        }
+
+        if (!_size) {
+            return;
+        }
+
+        size_t i = bucket(h);
+        size_t dist = 0;
+        meta_t m = M::make(h, 0);
+
+        while (true) {
+            meta_t m_i = _h[i];
+
+            if (m_i == M::with_distance(m, dist)) {
+                value_type & kv = _kv[i];
+                if (keys_equal(k, kv.first)) {
+                    _erase(i);
+                    return;
+                }
+            } else if (M::empty(m_i) || distance(i) < dist) {
+                return;
+            }
+
+            i = (i + 1) & _mask;
+            ++dist;
+        }
+    }
+
+    double load_factor() const {
+        return 1.0 * size() / _capacity;
+    }
+
+    // writes the table to path (see table_file.hpp), false if it can't
+    bool save(const char * path) {
+        migrate((size_t)-1);
+        TableFileHeader header = file_header();
+        header.capacity = _capacity;
+        header.size = _size;
+        header.mask = _mask;
+        const void * arrays[TABLE_FILE_ARRAYS] = { _h, _kv };
+        return table_file_save(path, header, arrays);
+    }
+
+    /*
+        Replaces the contents with a table saved to path, using the arrays
+        in the file where they are: nothing is read until a lookup gets to
+        it and a page is only copied once it's changed. false, with the
+        table left as it was, if path isn't a table saved by this type.
+    */
+    bool attach(const char * path) {
+        TableFileMap file;
+        const TableFileHeader * header = table_file_map(path, file_header(), file);
+        if (!header) {
+            return false;
+        }
+
+        destroy();
+        _file = file;
+        _h = (meta_t *)((char *)file.map + header->offsets[0]);
+        _kv = (value_type *)((char *)file.map + header->offsets[1]);
+        _capacity = header->capacity;
+        _size = header->size;
+        set_limits();
+        return true;
+    }
+
+    /*
+        Replaces the contents with keys[i] -> values[i] for i < n, sizing the
+        arrays once for n rather than growing into it. With threads > 1 the
+        input is partitioned by the high bits of its home bucket (see
+        bulk_load.hpp) and each thread fills its own ranges of slots. The
+        keys should be distinct; if they aren't, which value a key ends up
+        with is unspecified.
+    */
+    void bulk_load(const K * keys, const V * values, size_t n, size_t threads = 1) {
+        destroy();
+
+        _capacity = 4;
+        while (_load_factor * _capacity / 100 <= n) {
+            _capacity *= 2;
+        }
+        _size = 0;
+        alloc();
+
+        // ranges of only a few slots would mostly overflow, keep them to 4096 or more
+        size_t ranges = 1;
+        while (ranges < threads * 8 && (ranges << 13) <= _capacity) {
+            ranges *= 2;
+        }
+        unsigned shift = 0;
+        while ((ranges << shift) < _capacity) {
+            ++shift;
+        }
+        if (threads < 2 || ranges < 2) {
+            for (size_t i = 0; i < n; ++i) {
+                _set(hash_key(keys[i]), value_type(keys[i], values[i]));
+            }
+            return;
+        }
+
+        BulkPartitions parts;
+        bulk_partition(n, _mask, shift, ranges, threads, [&](size_t i) { return hash_key(keys[i]); }, parts);
+
+        std::vector<std::vector<value_type> > overflow(threads);
+        std::vector<size_t> added(threads);
+        bulk_parallel(threads, [&](size_t t) {
+            for (size_t p = t; p < ranges; p += threads) {
+                size_t end = (p + 1) << shift;
+                for (size_t j = parts.starts[p]; j < parts.starts[p + 1]; ++j) {
+                    size_t i = parts.order[j];
+                    value_type kv(keys[i], values[i]);
+                    switch (_set_bounded(parts.hashes[i], kv, end)) {
+                    case placed:
+                        ++added[t];
+                        break;
+                    case carried_out:
+                        overflow[t].push_back(std::move(kv));
+                        break;
+                    }
+                }
+            }
+        });
+
+        for (size_t t = 0; t < threads; ++t) {
+            _size += added[t];
+        }
+        for (size_t t = 0; t < threads; ++t) {
+            for (size_t j = 0; j < overflow[t].size(); ++j) {
+                value_type & kv = overflow[t][j];
+                _set(hash_key(kv.first), std::move(kv));
+            }
+        }
+    }
+
+    // fills in stats (see table_stats.h), with _old's entries while it's being emptied
+    void stats(table_stats & s) const {
+        table_stats_reset(&s);
+        add_stats(s);
+        if (_old) {
+            _old->add_stats(s);
+        }
+        s.rehashes = _rehashes;
+    }
+
+// private:
+
+    void add_stats(table_stats & s) const {
+        s.size += _size;
+        s.capacity += _capacity;
+        s.metadata_bytes += sizeof(meta_t) * _capacity;
+        s.payload_bytes += sizeof(value_type) * _capacity;
+        for (size_t i = 0; i < _capacity; ++i) {
+            if (!M::empty(_h[i])) {
+                table_stats_probe(&s, distance(i));
+            }
+        }
+    }
+
+    static const size_t batch_block = 16; // keys in flight at once in get_many
+
+    // removes the entry in slot i and shifts the rest of its cluster back
+    void _erase(size_t i) {
+        destruct(_kv[i]);
+        memset(&_h[i], M::empty_byte, sizeof(meta_t));
+        --_size;
+
+        if (size() == _shrink) {
+            rehash(_capacity / 2);
+        } else {
+            while (true) {
+                i = (i + 1) & _mask;
+                if (M::empty(_h[i])) {
+                    break;
+                }
+                size_t dist_i = distance(i);
+                if (!dist_i) {
+                    break;
+                }
+                _h[i] = M::with_distance(_h[i], dist_i - 1);
+                std::swap(_h[i], _h[(i - 1) & _mask]);
+                std::swap(_kv[i], _kv[(i - 1) & _mask]);
+            }
+        }
+    }
+
+    V * _get(const K & k, size_t h) {
+        size_t i = bucket(h);
+        size_t dist = 0;
+        meta_t m = M::make(h, 0);
+
+        while (true) {
+            meta_t m_i = _h[i];
+
+            if (m_i == M::with_distance(m, dist)) {
+                value_type & kv = _kv[i];
+                if (keys_equal(k, kv.first)) {
+                    return &kv.second;
+                }
+            } else if (M::empty(m_i) || distance(i) < dist) {
+                return NULL;
+            }
+
+            i = (i + 1) & _mask;
+            ++dist;
+        }
+    }
+
+    void rehash(size_t new_capacity) {
+        migrate((size_t)-1);
+        ++_rehashes;
+
+        auto old_capacity = _capacity;
+        auto h = _h;
+        auto kv = _kv;
+
+        _capacity = new_capacity;
+        _size = 0;
+        alloc();
+
+        for (size_t i = 0; i < old_capacity; ++i) {
+            if (!M::empty(h[i])) {
+                _set(M::stores_hash ? M::hash(h[i]) : hash_key(kv[i].first), std::move(kv[i]));
+            }
+        }
+
+        free_arrays(h, kv, old_capacity);
+    }
+
+    // moves the arrays to _old and starts over with empty ones
+    void start_rehash(size_t new_capacity) {
+        migrate((size_t)-1);
+        ++_rehashes;
+
+        _old = new Custom();
+        _old->free_arrays(_old->_h, _old->_kv, _old->_capacity);
+        std::swap(_old->_file, _file); // if the arrays are attached ones
+        _old->_h = _h;
+        _old->_kv = _kv;
+        _old->_capacity = _capacity;
+        _old->_size = _size;
+        _old->_grow = (size_t)-1; // never set into
+        _old->_shrink = (size_t)-1; // and never rehashed by del
+        _old->_mask = _mask;
+        _migrate_pos = 0;
+
+        _capacity = new_capacity;
+        _size = 0;
+        alloc();
+    }
+
+    // moves the entries of up to slots of _old's slots, dropping _old once it's empty
+    void migrate(size_t slots) {
+        while (_old && slots--) {
+            if (!_old->_size) {
+                delete _old;
+                _old = NULL;
+                break;
+            }
+
+            // deleting shifts the rest of the cluster back into this slot,
+            // so only move on once it's empty
+            size_t i = _migrate_pos;
+            if (M::empty(_old->_h[i])) {
+                ++_migrate_pos;
+                continue;
+            }
+            value_type & kv = _old->_kv[i];
+            size_t h = M::stores_hash ? M::hash(_old->_h[i]) : hash_key(kv.first);
+            value_type moved(std::move(kv));
+            _old->_erase(i);
+            _set(h, std::move(moved));
+        }
+    }
+
+    void alloc() {
+        // an all zero empty slot comes for free with fresh (or mapped) pages
+        _h = (meta_t *)slot_alloc(sizeof(meta_t) * _capacity, M::empty_byte == 0);
+        _kv = (value_type *)slot_alloc(sizeof(value_type) * _capacity, 0);
+        if (M::empty_byte != 0) {
+            memset(_h, M::empty_byte, sizeof(meta_t) * _capacity);
+        }
+        set_limits();
+    }
+
+    // what follows from _capacity
+    void set_limits() {
+        _grow = _load_factor * _capacity / 100;
+        _shrink = _load_factor * _capacity / 400;
+        _mask = _capacity - 1;
+    }
+
+    void free_arrays(meta_t * h, value_type * kv, size_t capacity) {
+        // attached arrays go with the file's mapping
+        if (_file.map && (char *)h >= (char *)_file.map && (char *)h < (char *)_file.map + _file.size) {
+            table_file_unmap(_file);
+            return;
+        }
+        slot_free(h, sizeof(meta_t) * capacity);
+        slot_free(kv, sizeof(value_type) * capacity);
+    }
+
+    // destructs the entries and frees the arrays, _old's too
+    void destroy() {
+        for (size_t i = 0; i < _capacity; ++i) {
+            if (!M::empty(_h[i])) {
+                destruct(_kv[i]);
+            }
+        }
+        free_arrays(_h, _kv, _capacity);
+        delete _old;
+        _old = NULL;
+    }
+
+    static TableFileHeader file_header() {
+        static_assert(std::is_trivially_copyable<K>::value && std::is_trivially_copyable<V>::value &&
+                      !std::is_pointer<K>::value && !std::is_pointer<V>::value,
+                      "only tables of plain bytes can be saved");
+        TableFileHeader header;
+        memset(&header, 0, sizeof(header));
+        table_file_ids<Custom, H>(header);
+        header.slot_bytes[0] = sizeof(meta_t);
+        header.slot_bytes[1] = sizeof(value_type);
+        return header;
+    }
+
+    void _set(size_t h, value_type && kv) {
+        size_t i = bucket(h);
+        size_t dist = 0;
+        meta_t m = M::make(h, 0);
+
+        while (true) {
+            meta_t m_i = _h[i];
+
+            if (m_i == M::with_distance(m, dist)) {
+                value_type & kv_i = _kv[i];
+                if (keys_equal(kv.first, kv_i.first)) {
+                    kv_i.second = std::move(kv.second);
+                    return;
+                }
+            } else if (M::empty(m_i)) {
+                construct(_kv[i], std::move(kv));
+                _h[i] = M::with_distance(m, dist);
+                ++_size;
+                return;
+            } else {
+                size_t dist_i = distance(i);
+                if (dist_i < dist) {
+                    // carry on with the poorer entry's metadata and key value pair
+                    meta_t m_carried = M::with_distance(m, dist);
+                    std::swap(_h[i], m_carried);
+                    m = m_carried;
+                    std::swap(_kv[i], kv);
+                    dist = dist_i;
+                }
+            }
+
+            i = (i + 1) & _mask;
+            ++dist;
+        }
+    }
+
+    enum { overwrote, placed, carried_out };
+
+    // _set for bulk_load's threads, which mustn't touch slot end or past it:
+    // the entry that would is left in kv (not necessarily the one passed in)
+    // for the caller to place. Doesn't count the entry in _size.
+    int _set_bounded(size_t h, value_type & kv, size_t end) {
+        size_t i = bucket(h);
+        size_t dist = 0;
+        meta_t m = M::make(h, 0);
+
+        while (true) {
+            meta_t m_i = _h[i];
+
+            if (m_i == M::with_distance(m, dist)) {
+                value_type & kv_i = _kv[i];
+                if (keys_equal(kv.first, kv_i.first)) {
+                    kv_i.second = std::move(kv.second);
+                    return overwrote;
+                }
+            } else if (M::empty(m_i)) {
+                construct(_kv[i], std::move(kv));
+                _h[i] = M::with_distance(m, dist);
+                return placed;
+            } else {
+                size_t dist_i = distance(i);
+                if (dist_i < dist) {
+                    meta_t m_carried = M::with_distance(m, dist);
+                    std::swap(_h[i], m_carried);
+                    m = m_carried;
+                    std::swap(_kv[i], kv);
+                    dist = dist_i;
+                }
+            }
+
+            if (++i == end) {
+                return carried_out;
+            }
+            ++dist;
+        }
+    }
+
+    inline static size_t hash_key(const K & k) {
+        size_t hk = H()(k);
+        return hk == -1 ? 0 : hk;
+    }
+
+    inline size_t bucket(size_t h) const {
+        return h & _mask;
+    }
+
+    inline size_t probe_distance(size_t h, size_t i) const {
+        return (i + _capacity - bucket(h)) & _mask;
+    }
+
+    // distance of the entry in slot i from its home bucket
+    inline size_t distance(size_t i) const {
+        size_t dist = M::distance(_h[i], i, _mask);
+        if (dist == M::saturated) {
+            dist = probe_distance(hash_key(_kv[i].first), i);
+        }
+        return dist;
+    }
+
+    inline static bool keys_equal(const K & k1, const K & k2) {
+        return P()(k1, k2);
+    }
+
+    inline static void construct(value_type & t, value_type && v) {
+        new (&t) value_type(std::move(v));
+    }
+
+    inline static void destruct(value_type & v) {
+        v.~value_type();
+    }
+
+    meta_t * __restrict _h; // per slot metadata, see FullHashMetadata
+    value_type * __restrict _kv; // key value pairs
+    size_t _capacity; // length of arrays
+    size_t _size; // number of items stored
+    size_t _load_factor; // maximum load factor before growing, /4 for minimum before shrinking
+    size_t _grow; // when _size >= _grow, _capcity *= 2
+    size_t _shrink; // when _size < _shrink, _capacity /= 2
+    size_t _mask; // used instead of % _capacity for speed
+    Custom * _old; // the arrays being moved out of by an incremental rehash, or NULL
+    size_t _migrate_pos; // next slot of _old to move
+    size_t _rehash_step; // slots of _old to move per set or del, 0 to rehash all at once
+    size_t _rehashes; // grows and shrinks so far, for stats()
+    TableFileMap _file; // the file _h and _kv are in, if they were attached
+};
+
+
+/*
+    Custom for const char * keys that copies the keys into the table (see
+    string_key.hpp), so comparing keys doesn't chase a pointer into the
+    caller's memory. The caller's strings needn't outlive the table.
+*/
+template <class V, class H = fnv1a_hash>
+class StringCustom {
+public:
+    typedef Custom<StringKey, V, StringKeyHash<H> > table_type;
+
+    V * get(const char * k) {
+        return get(k, strlen(k));
+    }
+
+    // the same with the key's length, for callers that already have it
+    V * get(const char * k, size_t len) {
+        return _table.get(StringKey(k, len));
+    }
+
+    // returns how many of the n keys are in the table
+    size_t contains_many(const char * const * keys, size_t n) {
+        StringKey block[table_type::batch_block];
+        size_t found = 0;
+        for (size_t b = 0; b < n; b += table_type::batch_block) {
+            size_t e = n - b < table_type::batch_block ? n - b : table_type::batch_block;
+            for (size_t j = 0; j < e; ++j) {
+                block[j] = StringKey(keys[b + j], strlen(keys[b + j]));
+            }
+            found += _table.contains_many(block, e);
+        }
+        return found;
+    }
+
+    void set(const char * k, V v) {
+        set(k, strlen(k), std::move(v));
+    }
+
+    void set(const char * k, size_t len, V v) {
+        StringKey key = _slab.own(k, len);
+        size_t size = _table.size();
+        _table.set(std::make_pair(key, std::move(v)));
+        if (_table.size() == size) {
+            _slab.undo(key); // overwrote, the table kept its own copy
+        }
+    }
+
+    void del(const char * k) {
+        del(k, strlen(k));
+    }
+
+    void del(const char * k, size_t len) {
+        _table.del(StringKey(k, len));
+    }
+
+    size_t size() const {
+        return _table.size();
+    }
+
+    void set_incremental_rehash(size_t slots) {
+        _table.set_incremental_rehash(slots);
+    }
+
+    void reserve(size_t n) {
+        _table.reserve(n);
+    }
+
+    // the table's stats, with the slab's bytes as payload
+    void stats(table_stats & s) const {
+        _table.stats(s);
+        s.payload_bytes += _slab.bytes();
+    }
+
+// private:
+
+    table_type _table;
+    StringSlab _slab;
+};
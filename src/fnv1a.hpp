@@ -1,3 +1,5 @@
+#pragma once
+
 #include <inttypes.h>
 #include <stddef.h>
 #include <functional>
@@ -0,0 +1,313 @@
+#include "fnv1a.hpp"
+
+#include <utility> // swap, pair
+#include <functional> // hash
+#include <cstdlib> // malloc, free
+#include <cstring> // memset
+#include <new> // bad_alloc
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+/*
+    Open addressing with a separate one-byte-per-slot control array.
+
+    Each control byte is either empty, deleted, or the top 7 bits of the
+    slot's hash (its fingerprint). Slots are probed a group of 16 at a time:
+    one SSE2 compare + movemask finds every fingerprint match in the group,
+    and only those slots have their keys compared. Groups are visited in
+    triangular order, which covers every group of a power of two table.
+*/
+template <class K, class V, class H = std::hash<K>, class P = std::equal_to<K> >
+class GroupProbe {
+public:
+    typedef std::pair<K, V> value_type;
+
+    static const size_t group_size = 16;
+
+    explicit GroupProbe():
+        _groups(1),
+        _size(0),
+        _deleted(0) {
+        alloc();
+    }
+
+    ~GroupProbe() {
+        for (size_t i = 0; i < capacity(); ++i) {
+            if (is_full(_ctrl[i])) {
+                destruct(_kv[i]);
+            }
+        }
+        free(_ctrl);
+        free(_kv);
+    }
+
+    size_t size() const {
+        return _size;
+    }
+
+    size_t capacity() const {
+        return _groups * group_size;
+    }
+
+    bool empty() const {
+        return !_size;
+    }
+
+    V * get(const K & k) {
+        size_t h = hash_key(k);
+        signed char fp = fingerprint(h);
+        size_t g = group(h);
+
+        for (size_t step = 1;; g = (g + step++) & _group_mask) {
+            const signed char * ctrl = _ctrl + g * group_size;
+
+            for (unsigned m = match(ctrl, fp); m; m &= m - 1) {
+                size_t i = g * group_size + __builtin_ctz(m);
+                if (keys_equal(k, _kv[i].first)) {
+                    return &_kv[i].second;
+                }
+            }
+
+            if (match(ctrl, ctrl_empty)) {
+                return NULL;
+            }
+        }
+    }
+
+    inline const V * get(const K & k) const {
+        return const_cast<GroupProbe *>(this)->get(k);
+    }
+
+    void set(value_type && kv) {
+        size_t h = hash_key(kv.first);
+        signed char fp = fingerprint(h);
+        size_t g = group(h);
+        size_t free_slot = -1;
+
+        for (size_t step = 1;; g = (g + step++) & _group_mask) {
+            const signed char * ctrl = _ctrl + g * group_size;
+
+            for (unsigned m = match(ctrl, fp); m; m &= m - 1) {
+                size_t i = g * group_size + __builtin_ctz(m);
+                if (keys_equal(kv.first, _kv[i].first)) {
+                    _kv[i].second = std::move(kv.second);
+                    return;
+                }
+            }
+
+            unsigned m = match_free(ctrl);
+            if (m && free_slot == -1) {
+                free_slot = g * group_size + __builtin_ctz(m);
+            }
+
+            if (match(ctrl, ctrl_empty)) {
+                break;
+            }
+        }
+
+        // not found, so it goes in the first free slot on its probe sequence
+        if (_ctrl[free_slot] == ctrl_deleted) {
+            --_deleted;
+        } else if (_size + _deleted == _grow) {
+            // growing moves everything, so the slot has to be found again
+            rehash(_deleted > _size / 2 ? _groups : _groups * 2);
+            _insert(h, std::move(kv));
+            return;
+        }
+
+        construct(_kv[free_slot], std::move(kv));
+        _ctrl[free_slot] = fp;
+        ++_size;
+    }
+
+    void del(const K & k) {
+        size_t h = hash_key(k);
+        signed char fp = fingerprint(h);
+        size_t g = group(h);
+
+        for (size_t step = 1;; g = (g + step++) & _group_mask) {
+            signed char * ctrl = _ctrl + g * group_size;
+
+            for (unsigned m = match(ctrl, fp); m; m &= m - 1) {
+                size_t i = g * group_size + __builtin_ctz(m);
+                if (keys_equal(k, _kv[i].first)) {
+                    destruct(_kv[i]);
+                    --_size;
+                    // probes only stop at a group with an empty slot, so if
+                    // this group already has one nobody can be probing past it
+                    if (match(ctrl, ctrl_empty)) {
+                        _ctrl[i] = ctrl_empty;
+                    } else {
+                        _ctrl[i] = ctrl_deleted;
+                        ++_deleted;
+                    }
+                    return;
+                }
+            }
+
+            if (match(ctrl, ctrl_empty)) {
+                return;
+            }
+        }
+    }
+
+    // grows the table so that n entries fit without growing again
+    void reserve(size_t n) {
+        size_t groups = _groups;
+        while (groups * group_size * 7 / 8 <= n) {
+            groups *= 2;
+        }
+        if (groups > _groups) {
+            rehash(groups);
+        }
+    }
+
+    double load_factor() const {
+        return 1.0 * _size / capacity();
+    }
+
+// private:
+
+    static const signed char ctrl_empty = -128; // 0b10000000
+    static const signed char ctrl_deleted = -2; // 0b11111110, full slots are 0b0xxxxxxx
+
+    void rehash(size_t new_groups) {
+        auto old_capacity = capacity();
+        auto ctrl = _ctrl;
+        auto kv = _kv;
+
+        _groups = new_groups;
+        _size = 0;
+        _deleted = 0;
+        alloc();
+
+        for (size_t i = 0; i < old_capacity; ++i) {
+            if (is_full(ctrl[i])) {
+                _insert(hash_key(kv[i].first), std::move(kv[i]));
+                destruct(kv[i]);
+            }
+        }
+
+        free(ctrl);
+        free(kv);
+    }
+
+    void alloc() {
+        _ctrl = (signed char *)malloc(capacity());
+        _kv = (value_type *)malloc(sizeof(value_type) * capacity());
+        if (!_ctrl || !_kv) {
+            throw std::bad_alloc();
+        }
+        memset(_ctrl, ctrl_empty, capacity());
+        _grow = capacity() * 7 / 8;
+        _group_mask = _groups - 1;
+    }
+
+    // insert a key known not to be in the table, without growing
+    void _insert(size_t h, value_type && kv) {
+        size_t g = group(h);
+
+        for (size_t step = 1;; g = (g + step++) & _group_mask) {
+            unsigned m = match_free(_ctrl + g * group_size);
+            if (m) {
+                size_t i = g * group_size + __builtin_ctz(m);
+                if (_ctrl[i] == ctrl_deleted) {
+                    --_deleted;
+                }
+                construct(_kv[i], std::move(kv));
+                _ctrl[i] = fingerprint(h);
+                ++_size;
+                return;
+            }
+        }
+    }
+
+#ifdef __SSE2__
+    // bit n is set if ctrl[n] == c
+    inline static unsigned match(const signed char * ctrl, signed char c) {
+        __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(c)));
+    }
+
+    // bit n is set if ctrl[n] is empty or deleted (the sign bit)
+    inline static unsigned match_free(const signed char * ctrl) {
+        return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)ctrl));
+    }
+#else
+    inline static unsigned match(const signed char * ctrl, signed char c) {
+        unsigned m = 0;
+        for (size_t n = 0; n < group_size; ++n) {
+            m |= (unsigned)(ctrl[n] == c) << n;
+        }
+        return m;
+    }
+
+    inline static unsigned match_free(const signed char * ctrl) {
+        unsigned m = 0;
+        for (size_t n = 0; n < group_size; ++n) {
+            m |= (unsigned)(ctrl[n] < 0) << n;
+        }
+        return m;
+    }
+#endif
+
+    inline static size_t hash_key(const K & k) {
+        // std::hash<int64_t> is the identity, so spread the bits before
+        // splitting them into a group index (low) and a fingerprint (high)
+        size_t hk = H()(k) * 0x9E3779B97F4A7C15ull;
+        return hk ^ (hk >> 32);
+    }
+
+    inline size_t group(size_t h) const {
+        return h & _group_mask;
+    }
+
+    inline static signed char fingerprint(size_t h) {
+        return h >> (sizeof(size_t) * 8 - 7);
+    }
+
+    inline static bool is_full(signed char c) {
+        return c >= 0;
+    }
+
+    inline static bool keys_equal(const K & k1, const K & k2) {
+        return P()(k1, k2);
+    }
+
+    inline static void construct(value_type & t, value_type && v) {
+        new (&t) value_type(std::move(v));
+    }
+
+    inline static void destruct(value_type & v) {
+        v.~value_type();
+    }
+
+    signed char * __restrict _ctrl; // control bytes, one per slot
+    value_type * __restrict _kv; // key value pairs
+    size_t _groups; // number of groups of group_size slots, 2 ** n
+    size_t _size; // number of items stored
+    size_t _deleted; // number of tombstones
+    size_t _grow; // when _size + _deleted reaches _grow, rehash
+    size_t _group_mask; // used instead of % _groups for speed
+};
+
+
+#include <cinttypes>
+#include "hash_policy.hpp"
+#ifndef STRING_HASH
+#define STRING_HASH fnv1a_hash
+#endif
+typedef GroupProbe<int64_t, int64_t> hash_t;
+typedef GroupProbe<const char *, int64_t, STRING_HASH> str_hash_t;
+#define SETUP hash_t hash; str_hash_t str_hash;
+#define SETUP_RESERVED(n) SETUP hash.reserve(n);
+#define INSERT_INT_INTO_HASH(key, value) hash.set(std::make_pair(key, value))
+#define LOOKUP_INT_IN_HASH(key) hash.get(key) != NULL
+#define DELETE_INT_FROM_HASH(key) hash.del(key)
+#define INSERT_STR_INTO_HASH(key, value) str_hash.set(std::make_pair(key, value))
+#define LOOKUP_STR_IN_HASH(key) str_hash.get(key) != NULL
+#define DELETE_STR_FROM_HASH(key) str_hash.del(key)
+#include "template.c"
@@ -0,0 +1,91 @@
+#include "hash_policy.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <time.h>
+#include <vector>
+
+
+/*
+    Hash function throughput, separate from any table.
+
+    For each key length, hashes a batch of distinct NUL terminated keys the
+    same way the tables do (strlen + hash) and prints one csv line:
+
+        hash,key_length,ns_per_hash,gb_per_sec
+*/
+
+
+// the table fallback of crc32c_hash, so both paths show up when built with SSE 4.2
+struct crc32c_sw_hash {
+    size_t operator()(const char * s) const {
+        return ~crc32c_hash::crc_sw(~0u, s, strlen(s)) * 0x9E3779B97F4A7C15ull;
+    }
+};
+
+
+static double get_time() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+
+static const size_t num_keys = 4096; // keeps every length in L1/L2
+static volatile size_t sink;
+
+
+template <class H>
+void bench(const char * name, const std::vector<const char *> & keys, size_t key_length) {
+    const H hasher = H();
+    size_t rounds = 1, h = 0;
+    double elapsed;
+
+    // double the rounds until the measurement takes long enough to trust
+    while (true) {
+        double before = get_time();
+        for (size_t r = 0; r < rounds; ++r) {
+            for (size_t i = 0; i < keys.size(); ++i) {
+                h ^= hasher(keys[i]);
+            }
+        }
+        elapsed = get_time() - before;
+        if (elapsed > 0.1) {
+            break;
+        }
+        rounds *= 2;
+    }
+    sink = h;
+
+    double hashes = 1.0 * rounds * keys.size();
+    printf("%s,%zu,%0.3f,%0.3f\n", name, key_length,
+        elapsed * 1e9 / hashes, hashes * key_length / elapsed / 1e9);
+    fflush(stdout);
+}
+
+
+int main(int argc, char ** argv) {
+    static const size_t key_lengths[] = {1, 2, 3, 4, 6, 8, 12, 16, 24, 32, 48, 64, 96, 128, 192, 256};
+
+    srandom(1);
+    for (size_t l = 0; l < sizeof(key_lengths) / sizeof(key_lengths[0]); ++l) {
+        size_t key_length = key_lengths[l];
+        std::vector<char> arena(num_keys * (key_length + 1));
+        std::vector<const char *> keys(num_keys);
+
+        for (size_t i = 0; i < num_keys; ++i) {
+            char * key = &arena[i * (key_length + 1)];
+            for (size_t j = 0; j < key_length; ++j) {
+                key[j] = 'a' + random() % 26;
+            }
+            key[key_length] = 0;
+            keys[i] = key;
+        }
+
+        bench<fnv1a_hash>("fnv1a", keys, key_length);
+        bench<wy_hash>("wyhash", keys, key_length);
+        bench<crc32c_hash>("crc32c", keys, key_length);
+        bench<crc32c_sw_hash>("crc32c-sw", keys, key_length);
+    }
+}
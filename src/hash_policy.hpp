@@ -0,0 +1,246 @@
+#pragma once
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <string.h> // memcpy, strlen
+#include <functional> // hash
+#include <type_traits> // is_integral
+
+#ifdef __SSE4_2__
+#include <nmmintrin.h>
+#endif
+
+#include "fnv1a.hpp"
+
+
+/*
+    Hash functors for const char * keys, for use as the H parameter of
+    Custom/GroupProbe or as HashTableTraits::hash_type (the integer ones
+    are at the end).
+
+    Each has a static hash(data, size) for when the length is already known,
+    and an operator() for NUL terminated keys.
+*/
+
+
+inline uint64_t read_u64(const char * p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+
+inline uint64_t read_u32(const char * p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+
+// byte at a time, what std::hash<const char *> uses (see fnv1a.hpp)
+struct fnv1a_hash {
+    static size_t hash(const char * data, size_t size) {
+        return fnv_1a<uint64_t>(data, size);
+    }
+
+    size_t operator()(const char * s) const {
+        return fnv_1a<uint64_t>(s);
+    }
+};
+
+
+// 8 bytes at a time, folding each 128 bit product back into 64 bits
+// (same construction as wyhash)
+struct wy_hash {
+    static uint64_t mum(uint64_t a, uint64_t b) {
+#ifdef __SIZEOF_INT128__
+        __uint128_t r = (__uint128_t)a * b;
+        return (uint64_t)r ^ (uint64_t)(r >> 64);
+#else
+        uint64_t ha = a >> 32, hb = b >> 32, la = (uint32_t)a, lb = (uint32_t)b;
+        uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+        uint64_t t = rl + (rm0 << 32), c = t < rl;
+        uint64_t lo = t + (rm1 << 32);
+        c += lo < t;
+        uint64_t hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+        return lo ^ hi;
+#endif
+    }
+
+    static size_t hash(const char * p, size_t size) {
+        static const uint64_t s0 = 0xa0761d6478bd642full;
+        static const uint64_t s1 = 0xe7037ed1a0b428dbull;
+        static const uint64_t s2 = 0x8ebc6af09c88c6e3ull;
+        static const uint64_t s3 = 0x589965cc75374cc3ull;
+        uint64_t seed = s0, a, b;
+
+        if (size <= 16) {
+            if (size >= 4) {
+                // two overlapping 4 byte reads from each end cover 4..16 bytes
+                size_t mid = (size >> 3) << 2;
+                a = (read_u32(p) << 32) | read_u32(p + mid);
+                b = (read_u32(p + size - 4) << 32) | read_u32(p + size - 4 - mid);
+            } else if (size) {
+                a = ((uint64_t)(unsigned char)p[0] << 16) |
+                    ((uint64_t)(unsigned char)p[size >> 1] << 8) |
+                    (unsigned char)p[size - 1];
+                b = 0;
+            } else {
+                a = b = 0;
+            }
+        } else {
+            size_t i = size;
+            if (i > 48) {
+                // three independent lanes keep the multipliers busy
+                uint64_t seed1 = seed, seed2 = seed;
+                do {
+                    seed = mum(read_u64(p) ^ s1, read_u64(p + 8) ^ seed);
+                    seed1 = mum(read_u64(p + 16) ^ s2, read_u64(p + 24) ^ seed1);
+                    seed2 = mum(read_u64(p + 32) ^ s3, read_u64(p + 40) ^ seed2);
+                    p += 48;
+                    i -= 48;
+                } while (i > 48);
+                seed ^= seed1 ^ seed2;
+            }
+            while (i > 16) {
+                seed = mum(read_u64(p) ^ s1, read_u64(p + 8) ^ seed);
+                i -= 16;
+                p += 16;
+            }
+            a = read_u64(p + i - 16);
+            b = read_u64(p + i - 8);
+        }
+
+        return mum(s1 ^ size, mum(a ^ s1, b ^ seed));
+    }
+
+    size_t operator()(const char * s) const {
+        return hash(s, strlen(s));
+    }
+};
+
+
+// CRC32C, 8 bytes per instruction with SSE 4.2, otherwise a byte at a time
+// from a lookup table
+struct crc32c_hash {
+    struct table {
+        uint32_t t[256];
+
+        table() {
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; ++k) {
+                    c = c & 1 ? (c >> 1) ^ 0x82f63b78u : c >> 1; // reflected Castagnoli
+                }
+                t[i] = c;
+            }
+        }
+    };
+
+    static uint32_t crc_sw(uint32_t crc, const char * p, size_t size) {
+        static const table tab;
+        while (size) {
+            crc = tab.t[(crc ^ (unsigned char)*p) & 0xff] ^ (crc >> 8);
+            ++p;
+            --size;
+        }
+        return crc;
+    }
+
+#ifdef __SSE4_2__
+    static uint32_t crc_hw(uint32_t crc, const char * p, size_t size) {
+        uint64_t c = crc;
+        for (; size >= 8; p += 8, size -= 8) {
+            c = _mm_crc32_u64(c, read_u64(p));
+        }
+        crc = (uint32_t)c;
+        if (size >= 4) {
+            crc = _mm_crc32_u32(crc, (uint32_t)read_u32(p));
+            p += 4;
+            size -= 4;
+        }
+        while (size) {
+            crc = _mm_crc32_u8(crc, *p);
+            ++p;
+            --size;
+        }
+        return crc;
+    }
+#endif
+
+    static size_t hash(const char * p, size_t size) {
+#ifdef __SSE4_2__
+        uint32_t crc = ~crc_hw(~0u, p, size);
+#else
+        uint32_t crc = ~crc_sw(~0u, p, size);
+#endif
+        // only 32 bits of hash, spread them over the whole word so that
+        // tables taking the high bits still get something
+        return crc * 0x9E3779B97F4A7C15ull;
+    }
+
+    size_t operator()(const char * s) const {
+        return hash(s, strlen(s));
+    }
+};
+
+
+/*
+    Hash functors for integer keys. std::hash<int64_t> is the identity, and
+    with a table taking the low bits as the bucket, keys that are multiples
+    of a power of two share a handful of buckets between them. key_hash<K>
+    picks one of these for integer K and std::hash<K> for anything else;
+    fibonacci unless the policy says otherwise.
+*/
+
+enum int_hash_policy { int_hash_identity, int_hash_fibonacci, int_hash_avalanche };
+
+
+// the key itself, only for keys known to be spread over the low bits already
+struct identity_hash {
+    size_t operator()(uint64_t k) const {
+        return k;
+    }
+};
+
+
+// multiply by 2 ** 64 / phi, whose high bits are the well spread ones, and
+// byte swap them down to the low bits the tables mask
+struct fibonacci_hash {
+    size_t operator()(uint64_t k) const {
+        return __builtin_bswap64(k * 0x9E3779B97F4A7C15ull);
+    }
+};
+
+
+// murmur3's 64 bit finalizer, every key bit flips each hash bit half the time
+struct avalanche_hash {
+    size_t operator()(uint64_t k) const {
+        k ^= k >> 33;
+        k *= 0xff51afd7ed558ccdull;
+        k ^= k >> 33;
+        k *= 0xc4ceb3f97a2f8e53ull;
+        return k ^ (k >> 33);
+    }
+};
+
+
+template <class K, int Policy = int_hash_fibonacci, bool Integral = std::is_integral<K>::value>
+struct key_hash {
+    typedef std::hash<K> type;
+};
+
+template <class K>
+struct key_hash<K, int_hash_identity, true> {
+    typedef identity_hash type;
+};
+
+template <class K>
+struct key_hash<K, int_hash_fibonacci, true> {
+    typedef fibonacci_hash type;
+};
+
+template <class K>
+struct key_hash<K, int_hash_avalanche, true> {
+    typedef avalanche_hash type;
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdlib.h>
+#include <stdio.h>
+
+/*
+    All the string keys of a run, built before the timer starts: the
+    decimal digits of each key, nul terminated, packed back to back in a
+    single arena. keys[i] stays valid for the life of the pool, so the
+    same pointer can be inserted, looked up and deleted, and lengths[i]
+    goes to the *_STR_LEN_* macros, so tables that take a length (the
+    StringKey ones) needn't call strlen.
+
+    With width > 0 every key is zero padded to (at least) width digits,
+    otherwise keys are as long as their number. The key numbers are
+    0..count-1, or random() after srandom(1) as the random benchmarks use.
+*/
+
+struct key_pool
+{
+    char * arena;
+    char ** keys;
+    int * lengths;
+    int count;
+};
+
+static int key_pool_digits(int num)
+{
+    int ndigits = 1;
+    while(num >= 10)
+    {
+        num /= 10;
+        ndigits++;
+    }
+    return ndigits;
+}
+
+static void key_pool_build(struct key_pool * pool, int count, int width, int random_keys)
+{
+    int * nums = (int *)malloc(sizeof(int) * count);
+    size_t arena_size = 0, offset = 0;
+    int i;
+
+    if(random_keys)
+        srandom(1); // for a fair/deterministic comparison
+    for(i = 0; i < count; i++)
+    {
+        int len;
+        nums[i] = random_keys ? (int)random() : i;
+        len = key_pool_digits(nums[i]);
+        arena_size += (len > width ? len : width) + 1;
+    }
+
+    pool->arena = (char *)malloc(arena_size);
+    pool->keys = (char **)malloc(sizeof(char *) * count);
+    pool->lengths = (int *)malloc(sizeof(int) * count);
+    pool->count = count;
+    for(i = 0; i < count; i++)
+    {
+        int len = sprintf(pool->arena + offset, "%0*d", width, nums[i]);
+        pool->keys[i] = pool->arena + offset;
+        pool->lengths[i] = len;
+        offset += len + 1;
+    }
+    free(nums);
+}
+
+static void key_pool_free(struct key_pool * pool)
+{
+    free(pool->arena);
+    free(pool->keys);
+    free(pool->lengths);
+    pool->count = 0;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+/*
+    A log bucketed (HDR style) histogram of operation latencies, in clock
+    ticks. Values below 2 ** LATENCY_SUB_BITS get a bucket each, above that
+    every power of two is split into 2 ** LATENCY_SUB_BITS buckets, so a
+    percentile is within 1 / 2 ** LATENCY_SUB_BITS (3%) of the real value.
+    The max is kept exactly.
+
+    The clock is the TSC on x86 and CLOCK_MONOTONIC elsewhere,
+    latency_ticks_per_ns() works out the conversion.
+*/
+
+#define LATENCY_SUB_BITS 5
+#define LATENCY_SUB_COUNT (1 << LATENCY_SUB_BITS)
+#define LATENCY_BUCKETS ((64 - LATENCY_SUB_BITS + 1) * LATENCY_SUB_COUNT)
+
+struct latency_hist
+{
+    uint64_t counts[LATENCY_BUCKETS];
+    uint64_t total;
+    uint64_t max;
+};
+
+static inline uint64_t latency_ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+/* measures the tick rate against CLOCK_MONOTONIC for 20ms */
+static double latency_ticks_per_ns(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    struct timespec start, now;
+    uint64_t ticks, ns;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ticks = latency_ticks();
+    do
+    {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        ns = (uint64_t)(now.tv_sec - start.tv_sec) * 1000000000ull + now.tv_nsec - start.tv_nsec;
+    } while(ns < 20000000);
+    return (double)(latency_ticks() - ticks) / ns;
+#else
+    return 1.0;
+#endif
+}
+
+static inline int latency_bucket(uint64_t value)
+{
+    int e;
+    if(value < LATENCY_SUB_COUNT)
+        return (int)value;
+    e = 63 - __builtin_clzll(value);
+    return ((e - LATENCY_SUB_BITS) << LATENCY_SUB_BITS) + (int)(value >> (e - LATENCY_SUB_BITS));
+}
+
+/* the highest value that lands in the bucket */
+static uint64_t latency_bucket_value(int bucket)
+{
+    int shift;
+    if(bucket < 2 * LATENCY_SUB_COUNT)
+        return bucket;
+    shift = (bucket >> LATENCY_SUB_BITS) - 1;
+    return (((uint64_t)(bucket & (LATENCY_SUB_COUNT - 1)) + LATENCY_SUB_COUNT + 1) << shift) - 1;
+}
+
+static void latency_reset(struct latency_hist * hist)
+{
+    memset(hist, 0, sizeof(*hist));
+}
+
+static inline void latency_record(struct latency_hist * hist, uint64_t ticks)
+{
+    hist->counts[latency_bucket(ticks)]++;
+    hist->total++;
+    if(ticks > hist->max)
+        hist->max = ticks;
+}
+
+/* the value at or below which a fraction p of the samples fall */
+static uint64_t latency_percentile(const struct latency_hist * hist, double p)
+{
+    uint64_t target = (uint64_t)(p * hist->total + 0.5), seen = 0;
+    int i;
+    if(target < 1)
+        target = 1;
+    for(i = 0; i < LATENCY_BUCKETS; i++)
+    {
+        seen += hist->counts[i];
+        if(seen >= target)
+            return latency_bucket_value(i) < hist->max ? latency_bucket_value(i) : hist->max;
+    }
+    return hist->max;
+}
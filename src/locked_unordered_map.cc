@@ -0,0 +1,44 @@
+#include <inttypes.h>
+#include <unordered_map>
+#include <mutex>
+#include "fnv1a.hpp"
+
+// the simplest thread safe map: one global lock around the whole table
+template <class M>
+struct Locked {
+    std::mutex lock;
+    M map;
+};
+
+typedef std::unordered_map<int64_t, int64_t> map_t;
+typedef std::unordered_map<const char *, int64_t> str_map_t;
+typedef Locked<map_t> hash_t;
+typedef Locked<str_map_t> str_hash_t;
+#define HASH_THREAD_SAFE
+#define SETUP hash_t hash; str_hash_t str_hash;
+#define SETUP_RESERVED(n) SETUP hash.map.reserve(n);
+#define INSERT_INT_INTO_HASH(key, value) do { \
+        std::lock_guard<std::mutex> guard(hash.lock); \
+        hash.map.insert(map_t::value_type(key, value)); \
+    } while(0)
+#define LOOKUP_INT_IN_HASH(key) do { \
+        std::lock_guard<std::mutex> guard(hash.lock); \
+        hash.map.find(key); \
+    } while(0)
+#define DELETE_INT_FROM_HASH(key) do { \
+        std::lock_guard<std::mutex> guard(hash.lock); \
+        hash.map.erase(key); \
+    } while(0)
+#define INSERT_STR_INTO_HASH(key, value) do { \
+        std::lock_guard<std::mutex> guard(str_hash.lock); \
+        str_hash.map.insert(str_map_t::value_type(key, value)); \
+    } while(0)
+#define LOOKUP_STR_IN_HASH(key) do { \
+        std::lock_guard<std::mutex> guard(str_hash.lock); \
+        str_hash.map.find(key); \
+    } while(0)
+#define DELETE_STR_FROM_HASH(key) do { \
+        std::lock_guard<std::mutex> guard(str_hash.lock); \
+        str_hash.map.erase(key); \
+    } while(0)
+#include "template.c"
@@ -1,6 +1,12 @@
 #include "fnv1a.hpp"
+#include "bulk_load.hpp"
+#include "hash_policy.hpp"
+#include "slot_layout.hpp"
+#include "table_file.hpp"
+#include "table_stats.h"
 
 #include <utility> // swap
+#include <type_traits> // is_trivially_copyable, is_pointer
 #include <functional> // hash
 #include <cstdlib> // malloc, realloc, free
 
@@ -10,55 +16,60 @@ using namespace std;
 
 template <class Key, class Value>
 struct HashTableTraits {
-    typedef std::hash<Key> hash_type;
+    typedef typename key_hash<Key>::type hash_type; // mixed for integer keys (hash_policy.hpp)
     typedef std::equal_to<Key> pred_type;
+    typedef InterleavedLayout<Key, Value> layout_type; // see slot_layout.hpp
     static const int grow_load_factor = 75; // percent
     static const int shrink_load_factor = 20; // percent
     static const int initial_array_size = 8; // must be 2 ** n
+    static const int batch_block = 16; // keys in flight at once in get_many
+    // > 0 grows incrementally: the old array stays next to the new one and
+    // each set or del moves the entries of this many of its slots across
+    // (2 or more finishes before the next grow), 0 moves everything at once
+    static const int incremental_rehash_step = 0;
 };
 
 
 template <class Key, class Value, class Traits = HashTableTraits<Key, Value> >
 class HashTable {
-    struct Entry {
-        size_t probe_distance;  // -1 means empty
-        Key key;
-        Value value;
+    typedef typename Traits::layout_type Layout;
 
-        Entry(size_t probe_distance, Key && key, Value && value):
-            probe_distance(probe_distance), key(std::move(key)), value(std::move(value)) {
-        }
-    };
+    static const size_t none = -1; // find()'s not found
 
-    Entry * entries;
+    Layout slots;
     size_t array_size;
     size_t entry_count;
     size_t bucket_mask;
     size_t grow_count;
     size_t shrink_count;
 
+    // the slots an incremental rehash is moving out of, if they're allocated()
+    Layout old_slots;
+    size_t old_array_size;
+    size_t old_bucket_mask;
+    size_t old_entry_count;
+    size_t migrate_pos;
+
+    size_t rehash_count; // grows and shrinks so far, for stats()
+    TableFileMap file; // the file the slots are in, if they were attached
+
     static size_t hash(const Key & key) {
-        static const typename Traits::hash_type hasher;
-        return hasher(key);
+        return typename Traits::hash_type()(key);
     }
 
     static bool pred(const Key & k1, const Key & k2) {
-        static const typename Traits::pred_type preder;
-        return preder(k1, k2);
+        return typename Traits::pred_type()(k1, k2);
     }
 
-    void rehash(size_t new_size) {
-        Entry * old_entries = entries;
-        size_t old_size = array_size;
-
-        array_size = new_size;
-        entries = (Entry *) malloc(sizeof(Entry) * new_size);
-        if (!entries) {
+    void allocate(size_t new_size) {
+        if (!slots.allocate(new_size)) {
             throw std::bad_alloc();
         }
-        for (size_t i = 0; i < new_size; ++i) {
-            entries[i].probe_distance = -1;
-        }
+        set_array_size(new_size);
+    }
+
+    void set_array_size(size_t new_size) {
+        array_size = new_size;
         bucket_mask = new_size - 1;
         grow_count = new_size * Traits::grow_load_factor / 100;
         if (new_size == Traits::initial_array_size) {
@@ -66,36 +77,128 @@ class HashTable {
         } else {
             shrink_count = new_size * Traits::shrink_load_factor / 100;
         }
+    }
 
-        if (old_entries) {
+    void rehash(size_t new_size) {
+        migrate(-1);
+
+        Layout old = slots;
+        size_t old_size = array_size;
+
+        allocate(new_size);
+
+        if (old.allocated()) {
+            ++rehash_count;
             for (size_t i = 0, e = entry_count; e && i < old_size; ++i) {
-                if (old_entries[i].probe_distance != -1) {
-                    set_helper(std::move(old_entries[i].key), std::move(old_entries[i].value));
-                    old_entries[i].~Entry();
+                if (!old.empty(i)) {
+                    set_helper(std::move(old.key(i)), std::move(old.value(i)));
+                    old.destruct(i);
                     --e;
                 }
             }
-            free(old_entries);
+            release(old);
         }
     }
 
-    Entry * find(const Key & key) {
-        size_t bucket = hash(key) & bucket_mask;
+    // frees a layout's arrays, or unmaps them if they're the attached ones
+    void release(Layout & array) {
+        char * start = (char *) array.array(0);
+        if (file.map && start >= (char *) file.map && start < (char *) file.map + file.size) {
+            table_file_unmap(file);
+            for (int a = 0; a < Layout::array_count; ++a) {
+                array.set_array(a, NULL);
+            }
+        } else {
+            array.free_arrays();
+        }
+    }
+
+    static TableFileHeader file_header() {
+        static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value &&
+                      !std::is_pointer<Key>::value && !std::is_pointer<Value>::value,
+                      "only tables of plain bytes can be saved");
+        static_assert(Layout::array_count <= TABLE_FILE_ARRAYS, "more arrays than a table file has room for");
+        TableFileHeader header;
+        memset(&header, 0, sizeof(header));
+        table_file_ids<HashTable, typename Traits::hash_type>(header);
+        for (int a = 0; a < Layout::array_count; ++a) {
+            header.slot_bytes[a] = Layout::slot_bytes(a);
+        }
+        return header;
+    }
+
+    // keeps the current slots as old_slots for migrate() to empty
+    void start_rehash(size_t new_size) {
+        migrate(-1);
+
+        // allocated first, so running out of memory leaves the table as it was
+        Layout fresh;
+        if (!fresh.allocate(new_size)) {
+            throw std::bad_alloc();
+        }
+
+        old_slots = slots;
+        old_array_size = array_size;
+        old_bucket_mask = bucket_mask;
+        old_entry_count = entry_count;
+        migrate_pos = 0;
+        ++rehash_count;
+
+        slots = fresh;
+        set_array_size(new_size);
+    }
+
+    // moves the entries of up to count of old_slots' slots into slots
+    void migrate(size_t count) {
+        while (old_slots.allocated() && count--) {
+            if (!old_entry_count) {
+                release(old_slots);
+                break;
+            }
+
+            // erasing shifts the rest of the cluster back into this slot,
+            // so only move on once it's empty
+            size_t i = migrate_pos;
+            if (old_slots.empty(i)) {
+                ++migrate_pos;
+                continue;
+            }
+            Key key(std::move(old_slots.key(i)));
+            Value value(std::move(old_slots.value(i)));
+            erase(old_slots, old_bucket_mask, i);
+            --old_entry_count;
+            set_helper(std::move(key), std::move(value));
+        }
+    }
+
+    // the value of key, in slots or old_slots, or NULL
+    Value * find(const Key & key, size_t key_hash) {
+        size_t i = find(slots, bucket_mask, key, key_hash);
+        if (i != none) {
+            return &slots.value(i);
+        }
+        if (old_slots.allocated() && (i = find(old_slots, old_bucket_mask, key, key_hash)) != none) {
+            return &old_slots.value(i);
+        }
+        return NULL;
+    }
+
+    static size_t find(const Layout & slots, size_t bucket_mask, const Key & key, size_t key_hash) {
+        size_t bucket = key_hash & bucket_mask;
         size_t probe_distance = 0;
 
         for (;; bucket = (bucket + 1) & bucket_mask, ++probe_distance) {
-            Entry & entry = entries[bucket];
-            size_t entry_probe_distance = entry.probe_distance;
+            size_t entry_probe_distance = slots.distance(bucket);
 
             if (entry_probe_distance == -1) {
                 // we expected to find it here, but this slot is empty...
-                return NULL;
+                return none;
             }
 
             if (entry_probe_distance == probe_distance) {
                 // check for matching keys
-                if (pred(key, entry.key)) {
-                    return &entry;
+                if (pred(key, slots.key(bucket))) {
+                    return bucket;
                 }
 
                 // keys dont match, it might be the next one (because of collisions)
@@ -104,7 +207,7 @@ class HashTable {
 
             if (entry_probe_distance < probe_distance) {
                 // we should have found the entry already, must not be here
-                return NULL;
+                return none;
             }
 
             // just keep looking...
@@ -113,25 +216,105 @@ class HashTable {
         // we will never get here...
     }
 
+    // destructs slot i and moves the following with PD > 0 left one position
+    static void erase(Layout & slots, size_t bucket_mask, size_t i) {
+        slots.destruct(i);
+
+        size_t bucket = (i + 1) & bucket_mask;
+        for (;; bucket = (bucket + 1) & bucket_mask) {
+            size_t probe_distance = slots.distance(bucket);
+            if (probe_distance == -1 || probe_distance == 0) {
+                break;
+            }
+            slots.construct((bucket - 1) & bucket_mask, probe_distance - 1,
+                            std::move(slots.key(bucket)), std::move(slots.value(bucket)));
+            slots.destruct(bucket);
+        }
+    }
+
+    static void add_stats(table_stats & s, const Layout & slots, size_t array_size) {
+        s.capacity += array_size;
+        s.metadata_bytes += sizeof(size_t) * array_size;
+        s.payload_bytes += (Layout::bytes_per_slot() - sizeof(size_t)) * array_size;
+        for (size_t i = 0; i < array_size; ++i) {
+            if (!slots.empty(i)) {
+                table_stats_probe(&s, slots.distance(i));
+            }
+        }
+    }
+
+    // destructs the entries and frees the arrays
+    void destroy() {
+        if (old_slots.allocated()) {
+            for (size_t i = 0; i < old_array_size; ++i) {
+                if (!old_slots.empty(i)) {
+                    old_slots.destruct(i);
+                }
+            }
+            release(old_slots);
+        }
+        if (slots.allocated()) {
+            for (size_t i = 0; i < array_size; ++i) {
+                if (!slots.empty(i)) {
+                    slots.destruct(i);
+                }
+            }
+            release(slots);
+        }
+    }
+
+    enum { overwrote, placed, carried_out };
+
+    // set_helper for bulk_load's threads, which mustn't touch bucket end or
+    // past it: the entry that would is left in key and value (not necessarily
+    // the ones passed in) for the caller to place
+    int set_bounded(Key & key, Value & value, size_t key_hash, size_t end) {
+        size_t bucket = key_hash & bucket_mask;
+        size_t probe_distance = 0;
+
+        for (;; ++probe_distance) {
+            size_t entry_probe_distance = slots.distance(bucket);
+
+            if (entry_probe_distance == -1) {
+                slots.construct(bucket, probe_distance, std::move(key), std::move(value));
+                return placed;
+            }
+
+            if (entry_probe_distance == probe_distance && pred(key, slots.key(bucket))) {
+                std::swap(slots.value(bucket), value);
+                return overwrote;
+            }
+
+            if (entry_probe_distance < probe_distance) {
+                std::swap(slots.key(bucket), key);
+                std::swap(slots.value(bucket), value);
+                std::swap(slots.distance(bucket), probe_distance);
+            }
+
+            if (++bucket == end) {
+                return carried_out;
+            }
+        }
+    }
+
     bool set_helper(Key && key, Value && value) {
         // returns if new element was added
         size_t bucket = hash(key) & bucket_mask;
         size_t probe_distance = 0;
 
         for (;; bucket = (bucket + 1) & bucket_mask, ++probe_distance) {
-            Entry & entry = entries[bucket];
-            size_t entry_probe_distance = entry.probe_distance;
+            size_t entry_probe_distance = slots.distance(bucket);
 
             if (entry_probe_distance == -1) {
                 // here's an empty spot! lets put it here
-                new (&entry) Entry(probe_distance, std::move(key), std::move(value));
+                slots.construct(bucket, probe_distance, std::move(key), std::move(value));
                 return true;
             }
 
             if (entry_probe_distance == probe_distance) {
                 // check for matching keys
-                if (pred(key, entry.key)) {
-                    std::swap(entry.value, value);
+                if (pred(key, slots.key(bucket))) {
+                    std::swap(slots.value(bucket), value);
                     return false;
                 }
 
@@ -141,9 +324,9 @@ class HashTable {
 
             if (entry_probe_distance < probe_distance) {
                 // this entry is closer than we would be, lets swap it out
-                std::swap(entry.key, key);
-                std::swap(entry.value, value);
-                std::swap(entry.probe_distance, probe_distance);
+                std::swap(slots.key(bucket), key);
+                std::swap(slots.value(bucket), value);
+                std::swap(slots.distance(bucket), probe_distance);
 
                 // and we'll find a new home for entry
                 continue;
@@ -159,40 +342,89 @@ class HashTable {
 public:
 
     HashTable():
-        entries(NULL),
-        entry_count(0)
+        entry_count(0),
+        rehash_count(0)
     {
+        file.map = NULL;
+        file.size = 0;
         rehash(Traits::initial_array_size);
     }
 
     ~HashTable() {
-        for (size_t i = 0, e = entry_count; e && i < array_size; ++i) {
-            Entry & entry = entries[i];
-            if (entry.probe_distance != -1) {
-                entry.~Entry();
-                --e;
-            }
-        }
-        free(entries);
+        destroy();
     }
 
     Value * get(const Key & key) {
         if (!entry_count)
             return NULL;
-        Entry * entry = find(key);
-        if (!entry)
-            return NULL;
-        return &entry->value;
+        return find(key, hash(key));
+    }
+
+    // look up n keys at once, out[i] = get(keys[i]), returns how many were found
+    size_t get_many(const Key * keys, size_t n, Value ** out) {
+        size_t found = 0;
+
+        if (!entry_count) {
+            for (size_t i = 0; i < n; ++i) {
+                out[i] = NULL;
+            }
+            return found;
+        }
+
+        // hash a block and prefetch all of its home buckets before resolving
+        // any of them, so the cache misses overlap
+        size_t hashes[Traits::batch_block];
+        for (size_t b = 0; b < n; b += Traits::batch_block) {
+            size_t e = n - b < Traits::batch_block ? n - b : Traits::batch_block;
+
+            for (size_t j = 0; j < e; ++j) {
+                hashes[j] = hash(keys[b + j]);
+                __builtin_prefetch(&slots.distance(hashes[j] & bucket_mask));
+            }
+
+            for (size_t j = 0; j < e; ++j) {
+                out[b + j] = find(keys[b + j], hashes[j]); // falls back to old_slots
+                found += out[b + j] != NULL;
+            }
+        }
+
+        return found;
+    }
+
+    // returns how many of the n keys are in the table
+    size_t contains_many(const Key * keys, size_t n) {
+        Value * out[Traits::batch_block];
+        size_t found = 0;
+        for (size_t b = 0; b < n; b += Traits::batch_block) {
+            found += get_many(keys + b, n - b < Traits::batch_block ? n - b : Traits::batch_block, out);
+        }
+        return found;
     }
 
     bool set(Key key, Value value) {
+        if (old_slots.allocated()) {
+            migrate(Traits::incremental_rehash_step);
+            // the key may not have been moved across yet
+            size_t i = old_slots.allocated() ? find(old_slots, old_bucket_mask, key, hash(key)) : none;
+            if (i != none) {
+                std::swap(old_slots.value(i), value);
+                return false;
+            }
+        }
+
         if (!set_helper(std::move(key), std::move(value))) {
             // no new element added
             return false;
         }
 
-        if (++entry_count >= grow_count)
-            rehash(array_size << 1); // double
+        if (++entry_count >= grow_count) {
+            // double
+            if (Traits::incremental_rehash_step) {
+                start_rehash(array_size << 1);
+            } else {
+                rehash(array_size << 1);
+            }
+        }
 
         return true;
     }
@@ -200,49 +432,293 @@ public:
     bool del(const Key & key) {
         if (!entry_count)
             return false;
-        Entry * entry = find(key);
-        if (!entry) {
-            return false;
+        if (old_slots.allocated()) {
+            migrate(Traits::incremental_rehash_step);
         }
 
-        entry->~Entry(); // destruct
-        entry->probe_distance = -1; // set as empty
+        size_t key_hash = hash(key);
+        size_t i = find(slots, bucket_mask, key, key_hash);
+        if (i != none) {
+            erase(slots, bucket_mask, i);
+        } else if (old_slots.allocated() && (i = find(old_slots, old_bucket_mask, key, key_hash)) != none) {
+            erase(old_slots, old_bucket_mask, i);
+            --old_entry_count;
+        } else {
+            return false;
+        }
 
         if (--entry_count < shrink_count) {
             rehash(array_size >> 1); // half
-            return true;
         }
 
-        // move the following with PD > 0 left one position
-        size_t bucket = (entry - entries + 1) & bucket_mask;
-        for (;; bucket = (bucket + 1) & bucket_mask) {
-            Entry & entry = entries[bucket];
-            if (entry.probe_distance == -1 || entry.probe_distance == 0) {
-                break;
+        return true;
+    }
+
+    // grows the array so that n entries fit without growing again
+    void reserve(size_t n) {
+        size_t new_size = array_size;
+        while (new_size * Traits::grow_load_factor / 100 <= n) {
+            new_size <<= 1;
+        }
+        if (new_size > array_size) {
+            rehash(new_size);
+        }
+    }
+
+    /*
+        Replaces the contents with keys[i] -> values[i] for i < n, sizing the
+        array once for n rather than growing into it. With threads > 1 the
+        input is partitioned by the high bits of its home bucket (see
+        bulk_load.hpp) and each thread fills its own ranges of buckets. The
+        keys should be distinct; if they aren't, which value a key ends up
+        with is unspecified.
+    */
+    void bulk_load(const Key * keys, const Value * values, size_t n, size_t threads = 1) {
+        destroy();
+
+        size_t new_size = Traits::initial_array_size;
+        while (new_size * Traits::grow_load_factor / 100 <= n) {
+            new_size <<= 1;
+        }
+        allocate(new_size);
+        entry_count = 0;
+
+        // ranges of only a few buckets would mostly overflow, keep them to 4096 or more
+        size_t ranges = 1;
+        while (ranges < threads * 8 && (ranges << 13) <= array_size) {
+            ranges <<= 1;
+        }
+        unsigned shift = 0;
+        while ((ranges << shift) < array_size) {
+            ++shift;
+        }
+        if (threads < 2 || ranges < 2) {
+            for (size_t i = 0; i < n; ++i) {
+                entry_count += set_helper(Key(keys[i]), Value(values[i]));
+            }
+            return;
+        }
+
+        BulkPartitions parts;
+        bulk_partition(n, bucket_mask, shift, ranges, threads, [&](size_t i) { return hash(keys[i]); }, parts);
+
+        std::vector<std::vector<std::pair<Key, Value> > > overflow(threads);
+        std::vector<size_t> added(threads);
+        bulk_parallel(threads, [&](size_t t) {
+            for (size_t p = t; p < ranges; p += threads) {
+                size_t end = (p + 1) << shift;
+                for (size_t j = parts.starts[p]; j < parts.starts[p + 1]; ++j) {
+                    size_t i = parts.order[j];
+                    Key key(keys[i]);
+                    Value value(values[i]);
+                    switch (set_bounded(key, value, parts.hashes[i], end)) {
+                    case placed:
+                        ++added[t];
+                        break;
+                    case carried_out:
+                        overflow[t].push_back(std::make_pair(std::move(key), std::move(value)));
+                        break;
+                    }
+                }
+            }
+        });
+
+        for (size_t t = 0; t < threads; ++t) {
+            entry_count += added[t];
+        }
+        for (size_t t = 0; t < threads; ++t) {
+            for (size_t j = 0; j < overflow[t].size(); ++j) {
+                entry_count += set_helper(std::move(overflow[t][j].first), std::move(overflow[t][j].second));
+            }
+        }
+    }
+
+    // writes the table to path (see table_file.hpp), false if it can't
+    bool save(const char * path) {
+        migrate(-1);
+        TableFileHeader header = file_header();
+        header.capacity = array_size;
+        header.size = entry_count;
+        header.mask = bucket_mask;
+        const void * arrays[TABLE_FILE_ARRAYS] = { NULL };
+        for (int a = 0; a < Layout::array_count; ++a) {
+            arrays[a] = slots.array(a);
+        }
+        return table_file_save(path, header, arrays);
+    }
+
+    // replaces the contents with a saved table, using the slots in the file where they are
+    bool attach(const char * path) {
+        TableFileMap mapped;
+        const TableFileHeader * header = table_file_map(path, file_header(), mapped);
+        if (!header) {
+            return false;
+        }
+
+        destroy();
+        file = mapped;
+        for (int a = 0; a < Layout::array_count; ++a) {
+            slots.set_array(a, (char *) mapped.map + header->offsets[a]);
+        }
+        entry_count = header->size;
+        set_array_size(header->capacity);
+        return true;
+    }
+
+    // fills in stats (see table_stats.h), with old_slots while they're being emptied
+    void stats(table_stats & s) const {
+        table_stats_reset(&s);
+        add_stats(s, slots, array_size);
+        if (old_slots.allocated()) {
+            add_stats(s, old_slots, old_array_size);
+        }
+        s.size = entry_count;
+        s.rehashes = rehash_count;
+    }
+};
+
+
+#include "string_key.hpp"
+
+#include <cstring> // strlen
+
+
+// HashTable for const char * keys that copies the keys into the table (see string_key.hpp)
+template <class Value, class Traits = HashTableTraits<StringKey, Value> >
+class StringHashTable {
+    typedef HashTable<StringKey, Value, Traits> table_type;
+
+    table_type table;
+    StringSlab slab;
+
+public:
+    Value * get(const char * key) {
+        return get(key, strlen(key));
+    }
+
+    // the same with the key's length, for callers that already have it
+    Value * get(const char * key, size_t len) {
+        return table.get(StringKey(key, len));
+    }
+
+    // returns how many of the n keys are in the table
+    size_t contains_many(const char * const * keys, size_t n) {
+        StringKey block[Traits::batch_block];
+        size_t found = 0;
+        for (size_t b = 0; b < n; b += Traits::batch_block) {
+            size_t e = n - b < Traits::batch_block ? n - b : Traits::batch_block;
+            for (size_t j = 0; j < e; ++j) {
+                block[j] = StringKey(keys[b + j], strlen(keys[b + j]));
             }
-            Entry & left_entry = entries[(bucket - 1) & bucket_mask];
-            new (&left_entry) Entry(entry.probe_distance - 1, std::move(entry.key), std::move(entry.value));
-            entry.probe_distance = -1;
-            entry.~Entry();
+            found += table.contains_many(block, e);
         }
+        return found;
+    }
 
+    bool set(const char * key, Value value) {
+        return set(key, strlen(key), std::move(value));
+    }
+
+    bool set(const char * key, size_t len, Value value) {
+        StringKey owned = slab.own(key, len);
+        if (!table.set(owned, std::move(value))) {
+            slab.undo(owned); // overwrote, the table kept its own copy
+            return false;
+        }
         return true;
     }
+
+    bool del(const char * key) {
+        return del(key, strlen(key));
+    }
+
+    bool del(const char * key, size_t len) {
+        return table.del(StringKey(key, len));
+    }
+
+    void reserve(size_t n) {
+        table.reserve(n);
+    }
+
+    // the table's stats, with the slab's bytes as payload
+    void stats(table_stats & s) const {
+        table.stats(s);
+        s.payload_bytes += slab.bytes();
+    }
 };
 
 
 #include <cinttypes>
-typedef HashTable<int64_t, int64_t> hash_t;
-typedef HashTable<const char *, int64_t> str_hash_t;
+#include "hash_policy.hpp"
+#ifndef STRING_HASH
+#define STRING_HASH fnv1a_hash
+#endif
+#ifndef INT_HASH
+#define INT_HASH fibonacci_hash
+#endif
+#ifndef INCREMENTAL_REHASH
+#define INCREMENTAL_REHASH 0
+#endif
+#ifndef SLOT_LAYOUT
+#define SLOT_LAYOUT InterleavedLayout
+#endif
+#ifdef VALUE_BYTES
+// the int table's values padded out to VALUE_BYTES, to see what wider values do to each layout
+struct value_t {
+    int64_t value;
+    char padding[VALUE_BYTES - sizeof(int64_t)];
+
+    value_t(int64_t value = 0): value(value) {
+    }
+};
+#else
+typedef int64_t value_t;
+#endif
+struct IntHashTableTraits : HashTableTraits<int64_t, value_t> {
+    typedef INT_HASH hash_type;
+    typedef SLOT_LAYOUT<int64_t, value_t> layout_type;
+    static const int incremental_rehash_step = INCREMENTAL_REHASH;
+};
+typedef HashTable<int64_t, value_t, IntHashTableTraits> hash_t;
+#ifdef INLINE_STRING_KEYS
+struct StrHashTableTraits : HashTableTraits<StringKey, int64_t> {
+    typedef StringKeyHash<STRING_HASH> hash_type;
+    typedef SLOT_LAYOUT<StringKey, int64_t> layout_type;
+    static const int incremental_rehash_step = INCREMENTAL_REHASH;
+};
+typedef StringHashTable<int64_t, StrHashTableTraits> str_hash_t;
+#else
+struct StrHashTableTraits : HashTableTraits<const char *, int64_t> {
+    typedef STRING_HASH hash_type;
+    typedef SLOT_LAYOUT<const char *, int64_t> layout_type;
+    static const int incremental_rehash_step = INCREMENTAL_REHASH;
+};
+typedef HashTable<const char *, int64_t, StrHashTableTraits> str_hash_t;
+#endif
 #define SETUP hash_t hash; str_hash_t str_hash;
+#define SETUP_RESERVED(n) SETUP hash.reserve(n);
 #define INSERT_INT_INTO_HASH(key, value) hash.set(key, value)
 #define LOOKUP_INT_IN_HASH(key) hash.get(key) != NULL
+#define LOOKUP_INT_BATCH_IN_HASH(keys, n) hash.contains_many(keys, n)
+#ifndef VALUE_BYTES
+#define BULK_LOAD_INT_INTO_HASH(keys, values, n, threads) hash.bulk_load(keys, values, n, threads)
+#endif
 #define DELETE_INT_FROM_HASH(key) hash.del(key)
+#define SAVE_INT_HASH(path) hash.save(path)
+#define ATTACH_INT_HASH(path) hash.attach(path)
 #define INSERT_STR_INTO_HASH(key, value) str_hash.set(key, value)
 #define LOOKUP_STR_IN_HASH(key) str_hash.get(key) != NULL
+#define LOOKUP_STR_BATCH_IN_HASH(keys, n) str_hash.contains_many(keys, n)
 #define DELETE_STR_FROM_HASH(key) str_hash.del(key)
+#ifdef INLINE_STRING_KEYS
+#define INSERT_STR_LEN_INTO_HASH(key, len, value) str_hash.set(key, len, value)
+#define LOOKUP_STR_LEN_IN_HASH(key, len) str_hash.get(key, len) != NULL
+#define DELETE_STR_LEN_FROM_HASH(key, len) str_hash.del(key, len)
+#endif
+#define INT_HASH_STATS(s) hash.stats(s)
+#define STR_HASH_STATS(s) str_hash.stats(s)
 
-#if 1
+#ifndef USE_TEMPLATE_C
 #include "template.cpp"
 #elif 1
 #include "template.c"
@@ -258,11 +734,10 @@ void dump(const H & hash_table) {
     cout << "\tprob.d\tkey\tvalue" << endl;
     for (size_t i = 0; i < hash_table.array_size; ++i) {
         cout << i << '\t';
-        typename H::Entry & entry = hash_table.entries[i];
-        if (entry.probe_distance == -1) {
+        if (hash_table.slots.empty(i)) {
             cout << "-\t-\t-";
         } else {
-            cout << entry.probe_distance << '\t' << entry.key << '\t' << entry.value;
+            cout << hash_table.slots.distance(i) << '\t' << hash_table.slots.key(i) << '\t' << hash_table.slots.value(i);
         }
         cout << endl;
     }
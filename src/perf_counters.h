@@ -0,0 +1,167 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+    Hardware counters for the timed region, through perf_event_open: cycles,
+    instructions, L1D read misses, LLC misses, dTLB read misses and branch
+    misses, counted in user space for this thread and the threads it starts.
+
+    Each counter is opened on its own so the kernel can multiplex them when
+    there are more than the PMU has room for, and the counts are scaled up
+    by time enabled / time running. Counters that can't be opened (no PMU in
+    a VM, perf_event_paranoid, not Linux, -DNO_PERF_COUNTERS) are left out:
+    perf_counters_read() reports them as -1 and the harness skips them.
+*/
+
+enum
+{
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_DTLB_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_COUNTER_COUNT
+};
+
+static const char * const perf_counter_names[PERF_COUNTER_COUNT] = {
+    "cycles", "instructions", "l1d_misses", "llc_misses", "dtlb_misses", "branch_misses"
+};
+
+struct perf_counters
+{
+    int fds[PERF_COUNTER_COUNT];
+};
+
+#if defined(__linux__) && !defined(NO_PERF_COUNTERS)
+
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+static void perf_counter_attr(struct perf_event_attr * attr, int counter)
+{
+    static const uint64_t read_miss = (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+
+    memset(attr, 0, sizeof(*attr));
+    attr->size = sizeof(*attr);
+    attr->type = PERF_TYPE_HARDWARE;
+    switch(counter)
+    {
+        case PERF_CYCLES:
+            attr->config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case PERF_INSTRUCTIONS:
+            attr->config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case PERF_L1D_MISSES:
+            attr->type = PERF_TYPE_HW_CACHE;
+            attr->config = PERF_COUNT_HW_CACHE_L1D | read_miss;
+            break;
+        case PERF_LLC_MISSES:
+            attr->config = PERF_COUNT_HW_CACHE_MISSES;
+            break;
+        case PERF_DTLB_MISSES:
+            attr->type = PERF_TYPE_HW_CACHE;
+            attr->config = PERF_COUNT_HW_CACHE_DTLB | read_miss;
+            break;
+        case PERF_BRANCH_MISSES:
+            attr->config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+    }
+    attr->disabled = 1;
+    attr->inherit = 1;
+    attr->exclude_kernel = 1;
+    attr->exclude_hv = 1;
+    attr->read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+}
+
+/* returns how many counters could be opened */
+static int perf_counters_open(struct perf_counters * pc)
+{
+    struct perf_event_attr attr;
+    int i, opened = 0;
+    for(i = 0; i < PERF_COUNTER_COUNT; i++)
+    {
+        perf_counter_attr(&attr, i);
+        pc->fds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        opened += pc->fds[i] >= 0;
+    }
+    return opened;
+}
+
+static void perf_counters_ioctl(struct perf_counters * pc, unsigned long request)
+{
+    int i;
+    for(i = 0; i < PERF_COUNTER_COUNT; i++)
+    {
+        if(pc->fds[i] >= 0)
+            ioctl(pc->fds[i], request, 0);
+    }
+}
+
+/* zeroes the counts and starts counting */
+static void perf_counters_start(struct perf_counters * pc)
+{
+    perf_counters_ioctl(pc, PERF_EVENT_IOC_RESET);
+    perf_counters_ioctl(pc, PERF_EVENT_IOC_ENABLE);
+}
+
+/* carries on counting without zeroing */
+static void perf_counters_resume(struct perf_counters * pc)
+{
+    perf_counters_ioctl(pc, PERF_EVENT_IOC_ENABLE);
+}
+
+static void perf_counters_stop(struct perf_counters * pc)
+{
+    perf_counters_ioctl(pc, PERF_EVENT_IOC_DISABLE);
+}
+
+/* counts since perf_counters_start(), -1 for counters that aren't there */
+static void perf_counters_read(struct perf_counters * pc, double * values)
+{
+    uint64_t buf[3]; /* value, time enabled, time running */
+    int i;
+    for(i = 0; i < PERF_COUNTER_COUNT; i++)
+    {
+        values[i] = -1;
+        if(pc->fds[i] < 0 || read(pc->fds[i], buf, sizeof(buf)) != sizeof(buf))
+            continue;
+        values[i] = buf[2] ? (double)buf[0] * buf[1] / buf[2] : 0;
+    }
+}
+
+#else
+
+static int perf_counters_open(struct perf_counters * pc)
+{
+    int i;
+    for(i = 0; i < PERF_COUNTER_COUNT; i++)
+        pc->fds[i] = -1;
+    return 0;
+}
+
+static void perf_counters_start(struct perf_counters * pc)
+{
+}
+
+static void perf_counters_resume(struct perf_counters * pc)
+{
+}
+
+static void perf_counters_stop(struct perf_counters * pc)
+{
+}
+
+static void perf_counters_read(struct perf_counters * pc, double * values)
+{
+    int i;
+    for(i = 0; i < PERF_COUNTER_COUNT; i++)
+        values[i] = -1;
+}
+
+#endif
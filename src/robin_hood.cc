@@ -2,18 +2,24 @@
 #include <utility>
 #include <functional>
 #include <cstdlib>
+#include <stdexcept>
 #include "fnv1a.hpp"
+#include "slot_alloc.h"
+#include "table_stats.h"
 
 #define USE_ROBIN_HOOD_HASH 1
 #define USE_SEPARATE_HASH_ARRAY 1
-#define _aligned_malloc(X, Y) malloc(X)
-#define _aligned_free free
+// erase shifts the rest of the cluster back a slot instead of leaving a tombstone
+#ifndef USE_BACKWARD_SHIFT_DELETE
+#define USE_BACKWARD_SHIFT_DELETE 0
+#endif
 
 template<class Key, class Value>
 class hash_table
 {
   static const int INITIAL_SIZE = 256;
     static const int LOAD_FACTOR_PERCENT = 90;
+    static const int MAX_CAPACITY = 1 << 30; // the biggest power of two an int holds
 
     struct elem
     {
@@ -31,9 +37,11 @@ class hash_table
 #endif
 
     int num_elems;
+    int num_deleted; // tombstones, which take up slots until the next grow
     int capacity;
     int resize_threshold;
     uint32_t mask;
+    int num_rehashes;
 
     static uint32_t hash_key(const Key& key)
     {
@@ -84,30 +92,36 @@ class hash_table
     // alloc buffer according to currently set capacity
     void alloc()
     {
-        buffer = reinterpret_cast<elem*>(_aligned_malloc(capacity*sizeof(elem), __alignof(elem)));
+        buffer = reinterpret_cast<elem*>(slot_alloc(capacity*sizeof(elem), 0));
 #if USE_SEPARATE_HASH_ARRAY
-        hashes = new uint32_t[capacity];
-#endif
-
+        // 0 flags an elem as free, which the zeroed array already is
+        hashes = static_cast<uint32_t*>(slot_alloc(capacity*sizeof(uint32_t), 1));
+#else
         // flag all elems as free
         for( int i = 0; i < capacity; ++i)
         {
             elem_hash(i) = 0;
         }
+#endif
 
-        resize_threshold = (capacity * LOAD_FACTOR_PERCENT) / 100;
+        num_deleted = 0;
+        resize_threshold = (int)((int64_t)capacity * LOAD_FACTOR_PERCENT / 100);
         mask = capacity - 1;
     }
 
-    void grow()
+    void grow(int64_t new_capacity)
     {
+        if (new_capacity > MAX_CAPACITY)
+            throw std::length_error("hash_table: more slots than an int capacity holds");
+
         elem* old_elems = buffer;
         int old_capacity = capacity;
 #if USE_SEPARATE_HASH_ARRAY
         auto old_hashes = hashes;
 #endif
-        capacity *= 2;
+        capacity = (int)new_capacity;
         alloc();
+        ++num_rehashes;
 
         // now copy over old elems
         for(int i = 0; i < old_capacity; ++i)
@@ -125,9 +139,9 @@ class hash_table
             }
         }
 
-        _aligned_free(old_elems);
+        slot_free(old_elems, old_capacity*sizeof(elem));
 #if USE_SEPARATE_HASH_ARRAY
-        delete [] old_hashes;
+        slot_free(old_hashes, old_capacity*sizeof(uint32_t));
 #endif
     }
 
@@ -137,7 +151,8 @@ class hash_table
         elem_hash(ix) = hash;
     }
 
-    void insert_helper(uint32_t hash, Key&& key, Value&& val)
+    // returns false if key was already there and only its value was replaced
+    bool insert_helper(uint32_t hash, Key&& key, Value&& val)
     {
         int pos = desired_pos(hash);
         int dist = 0;
@@ -147,13 +162,13 @@ class hash_table
 
             if (h == hash && buffer[pos].key == key) {
                 std::swap(buffer[pos].value, val);
-                return;
+                return false;
             }
 
             if(h == 0)
             {
                 construct(pos, hash, std::move(key), std::move(val));
-                return;
+                return true;
             }
 
             // If the existing elem has probed less than us, then swap places with existing
@@ -164,7 +179,8 @@ class hash_table
                 if(is_deleted(elem_hash(pos)))
                 {
                     construct(pos, hash, std::move(key), std::move(val));
-                    return;
+                    --num_deleted;
+                    return true;
                 }
 
                 std::swap(hash, elem_hash(pos));
@@ -198,32 +214,45 @@ class hash_table
     }
 
 public:
-    hash_table() : buffer(nullptr), num_elems(0), capacity(INITIAL_SIZE)
+    hash_table() : buffer(nullptr), num_elems(0), capacity(INITIAL_SIZE), num_rehashes(0)
     {
         alloc();
     }
 
     void insert(Key key, Value val)
     {
-        if (++num_elems >= resize_threshold)
+        if (!insert_helper(hash_key(key), std::move(key), std::move(val)))
+            return; // overwrote
+
+        // tombstones fill slots too, when they're most of it rebuild at the same size
+        if (++num_elems + num_deleted >= resize_threshold)
         {
-            grow();
+            grow(num_deleted > num_elems ? capacity : (int64_t)capacity * 2);
         }
-        insert_helper(hash_key(key), std::move(key), std::move(val));
+    }
+
+    // grows the buffer so that n elements fit without growing again
+    void reserve(int n)
+    {
+        int64_t new_capacity = capacity;
+        while (new_capacity * LOAD_FACTOR_PERCENT / 100 <= n)
+            new_capacity *= 2;
+        if (new_capacity > capacity)
+            grow(new_capacity);
     }
 
     ~hash_table()
     {
         for( int i = 0; i < capacity; ++i)
         {
-            if (elem_hash(i) != 0)
+            if (elem_hash(i) != 0 && !is_deleted(elem_hash(i)))
             {
                 buffer[i].~elem();
             }
         }
-        _aligned_free(buffer);
+        slot_free(buffer, capacity*sizeof(elem));
 #if USE_SEPARATE_HASH_ARRAY
-        delete [] hashes;
+        slot_free(hashes, capacity*sizeof(uint32_t));
 #endif
     }
 
@@ -242,13 +271,25 @@ public:
     bool erase(const Key& key)
     {
         const uint32_t hash = hash_key(key);
-        const int ix = lookup_index(key);
+        int ix = lookup_index(key);
 
         if (ix == -1) return false;
 
         buffer[ix].~elem();
-        elem_hash(ix) |= 0x80000000; // mark as deleted
         --num_elems;
+#if USE_BACKWARD_SHIFT_DELETE
+        // move the rest of the cluster back a slot, up to an empty slot or an elem already home
+        for (int next = (ix + 1) & mask; elem_hash(next) != 0 && probe_distance(elem_hash(next), next) != 0; next = (next + 1) & mask)
+        {
+            construct(ix, elem_hash(next), std::move(buffer[next].key), std::move(buffer[next].value));
+            buffer[next].~elem();
+            ix = next;
+        }
+        elem_hash(ix) = 0;
+#else
+        elem_hash(ix) |= 0x80000000; // mark as deleted
+        ++num_deleted;
+#endif
         return true;
     }
 
@@ -270,15 +311,41 @@ public:
         }
         return probe_total / size() + 1.0f;
     }
+
+    // fills in stats (see table_stats.h)
+    void stats(table_stats& s) const
+    {
+        table_stats_reset(&s);
+        s.size = num_elems;
+        s.capacity = capacity;
+        s.metadata_bytes = capacity * sizeof(uint32_t);
+#if USE_SEPARATE_HASH_ARRAY
+        s.payload_bytes = capacity * sizeof(elem);
+#else
+        s.payload_bytes = capacity * (sizeof(elem) - sizeof(uint32_t));
+#endif
+        s.rehashes = num_rehashes;
+        for(int i = 0; i < capacity; ++i)
+        {
+            uint32_t hash = elem_hash(i);
+            if (is_deleted(hash))
+                ++s.tombstones;
+            else if (hash != 0)
+                table_stats_probe(&s, probe_distance(hash, i));
+        }
+    }
 };
 
 typedef hash_table<int64_t, int64_t> hash_t;
 typedef hash_table<const char *, int64_t> str_hash_t;
 #define SETUP hash_t hash; str_hash_t str_hash;
+#define SETUP_RESERVED(n) SETUP hash.reserve(n);
 #define INSERT_INT_INTO_HASH(key, value) hash.insert(key, value)
 #define LOOKUP_INT_IN_HASH(key) hash.find(key) != NULL
 #define DELETE_INT_FROM_HASH(key) hash.erase(key)
 #define INSERT_STR_INTO_HASH(key, value) str_hash.insert(key, value)
 #define LOOKUP_STR_IN_HASH(key) str_hash.find(key) != NULL
 #define DELETE_STR_FROM_HASH(key) str_hash.erase(key)
+#define INT_HASH_STATS(s) hash.stats(s)
+#define STR_HASH_STATS(s) str_hash.stats(s)
 #include "template.c"
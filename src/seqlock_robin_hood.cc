@@ -0,0 +1,434 @@
+#include "fnv1a.hpp"
+#include "hash_policy.hpp"
+
+#include <utility> // swap
+#include <functional> // hash
+#include <cstdlib> // malloc, free, abort
+#include <cstring> // memcpy
+#include <atomic>
+#include <mutex>
+#include <new> // bad_alloc
+#include <type_traits> // is_trivially_copyable
+#include <vector>
+
+
+template <class Key, class Value>
+struct SeqlockHashTableTraits {
+    typedef typename key_hash<Key>::type hash_type; // mixed for integer keys (hash_policy.hpp)
+    typedef std::equal_to<Key> pred_type;
+    static const int grow_load_factor = 75; // percent
+    static const int shrink_load_factor = 20; // percent
+    static const int initial_array_size = 8; // must be 2 ** n
+    static const int segment_bits = 6; // 2 ** n segments
+    static const int max_threads = 256; // threads that can ever read one table
+};
+
+
+/*
+    HashTable's robin hood layout, split into segments that readers never
+    lock.
+
+    Each segment has a sequence counter that its writers make odd while they
+    change it, and a mutex that serialises its writers. A reader takes a
+    snapshot of the counter, probes, and retries if the counter moved. Keys
+    are only compared once the snapshot of them is known to be consistent,
+    so a pointer key (const char *) is never followed while torn.
+
+    Growing or shrinking a segment builds a new array next to the old one
+    and then swaps a pointer. Old arrays go to an epoch based reclaimer: a
+    reader announces the global epoch while it is inside get(), and an array
+    retired at epoch e is freed once no reader is still announcing e or less.
+*/
+template <class Key, class Value, class Traits = SeqlockHashTableTraits<Key, Value> >
+class SeqlockHashTable {
+    static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value,
+        "readers copy entries that may be changing under them");
+
+    struct Entry {
+        size_t probe_distance;  // -1 means empty
+        Key key;
+        Value value;
+    };
+
+    struct Array {
+        Entry * entries;
+        size_t bucket_mask;
+    };
+
+    struct alignas(64) Segment {
+        std::atomic<size_t> seq; // odd while a writer is changing the segment
+        std::atomic<Array *> array;
+        std::mutex lock; // writers only
+        size_t entry_count;
+        size_t grow_count;
+        size_t shrink_count;
+    };
+
+    struct alignas(64) ReaderSlot {
+        std::atomic<uint64_t> epoch; // 0 when not reading
+    };
+
+    struct Retired {
+        Array * array;
+        uint64_t epoch;
+    };
+
+    static const size_t segment_count = (size_t)1 << Traits::segment_bits;
+
+    Segment segments[segment_count];
+    ReaderSlot readers[Traits::max_threads];
+    std::atomic<uint64_t> epoch;
+    std::mutex retire_lock;
+    std::vector<Retired> retired;
+
+    static size_t hash(const Key & key) {
+        return typename Traits::hash_type()(key);
+    }
+
+    static bool pred(const Key & k1, const Key & k2) {
+        return typename Traits::pred_type()(k1, k2);
+    }
+
+    Segment & segment(size_t key_hash) {
+        // hash_type may be the identity, so mix before taking the high bits
+        return segments[(key_hash * 0x9E3779B97F4A7C15ull) >> (sizeof(size_t) * 8 - Traits::segment_bits)];
+    }
+
+    static int thread_index() {
+        static std::atomic<int> next_index(0);
+        static thread_local int index = next_index++;
+        if (index >= Traits::max_threads) {
+            abort();
+        }
+        return index;
+    }
+
+    // epochs
+
+    ReaderSlot & enter() {
+        ReaderSlot & slot = readers[thread_index()];
+        slot.epoch.store(epoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        // the announcement must be visible before we load any array pointer
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return slot;
+    }
+
+    static void leave(ReaderSlot & slot) {
+        slot.epoch.store(0, std::memory_order_release);
+    }
+
+    void retire(Array * array) {
+        std::lock_guard<std::mutex> guard(retire_lock);
+        Retired r = {array, epoch.fetch_add(1)};
+        retired.push_back(r);
+
+        uint64_t oldest = -1;
+        for (int i = 0; i < Traits::max_threads; ++i) {
+            uint64_t e = readers[i].epoch.load();
+            if (e && e < oldest) {
+                oldest = e;
+            }
+        }
+
+        size_t kept = 0;
+        for (size_t i = 0; i < retired.size(); ++i) {
+            if (retired[i].epoch < oldest) {
+                free_array(retired[i].array);
+            } else {
+                retired[kept++] = retired[i];
+            }
+        }
+        retired.resize(kept);
+    }
+
+    // arrays
+
+    static Array * alloc_array(size_t size) {
+        Array * array = new Array;
+        array->entries = (Entry *) malloc(sizeof(Entry) * size);
+        if (!array->entries) {
+            throw std::bad_alloc();
+        }
+        for (size_t i = 0; i < size; ++i) {
+            array->entries[i].probe_distance = -1;
+        }
+        array->bucket_mask = size - 1;
+        return array;
+    }
+
+    static void free_array(Array * array) {
+        free(array->entries);
+        delete array;
+    }
+
+    // readers
+
+    // 1 found, 0 not found, -1 the segment changed under us
+    static int find(const Array * array, const Key & key, size_t key_hash,
+                    const Segment & s, size_t seq, Value & value) {
+        size_t bucket = key_hash & array->bucket_mask;
+        size_t probe_distance = 0;
+
+        for (;; bucket = (bucket + 1) & array->bucket_mask, ++probe_distance) {
+            const Entry & entry = array->entries[bucket];
+            size_t entry_probe_distance = __atomic_load_n(&entry.probe_distance, __ATOMIC_RELAXED);
+
+            if (entry_probe_distance == -1 || entry_probe_distance < probe_distance) {
+                return 0;
+            }
+
+            if (probe_distance > array->bucket_mask) {
+                // only possible if we raced with a writer
+                return -1;
+            }
+
+            if (entry_probe_distance == probe_distance) {
+                Key entry_key;
+                memcpy(&entry_key, &entry.key, sizeof(Key));
+                memcpy(&value, &entry.value, sizeof(Value));
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (s.seq.load(std::memory_order_relaxed) != seq) {
+                    return -1;
+                }
+                if (pred(key, entry_key)) {
+                    return 1;
+                }
+            }
+        }
+    }
+
+    // writers, with the segment lock held
+
+    static void begin_write(Segment & s) {
+        s.seq.store(s.seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    static void end_write(Segment & s) {
+        s.seq.store(s.seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    static Entry * find_locked(Array * array, const Key & key, size_t key_hash) {
+        size_t bucket = key_hash & array->bucket_mask;
+        size_t probe_distance = 0;
+
+        for (;; bucket = (bucket + 1) & array->bucket_mask, ++probe_distance) {
+            Entry & entry = array->entries[bucket];
+            if (entry.probe_distance == -1 || entry.probe_distance < probe_distance) {
+                return NULL;
+            }
+            if (entry.probe_distance == probe_distance && pred(key, entry.key)) {
+                return &entry;
+            }
+        }
+    }
+
+    static bool set_helper(Array * array, size_t key_hash, Key key, Value value) {
+        // returns if new element was added
+        size_t bucket = key_hash & array->bucket_mask;
+        size_t probe_distance = 0;
+
+        for (;; bucket = (bucket + 1) & array->bucket_mask, ++probe_distance) {
+            Entry & entry = array->entries[bucket];
+
+            if (entry.probe_distance == -1) {
+                entry.key = key;
+                entry.value = value;
+                __atomic_store_n(&entry.probe_distance, probe_distance, __ATOMIC_RELAXED);
+                return true;
+            }
+
+            if (entry.probe_distance == probe_distance && pred(key, entry.key)) {
+                entry.value = value;
+                return false;
+            }
+
+            if (entry.probe_distance < probe_distance) {
+                // this entry is closer than we would be, lets swap it out
+                std::swap(entry.key, key);
+                std::swap(entry.value, value);
+                size_t entry_probe_distance = entry.probe_distance;
+                __atomic_store_n(&entry.probe_distance, probe_distance, __ATOMIC_RELAXED);
+                probe_distance = entry_probe_distance;
+            }
+        }
+    }
+
+    void resize(Segment & s, size_t new_size) {
+        // readers carry on with the old array while the new one is built
+        Array * old_array = s.array.load(std::memory_order_relaxed);
+        Array * new_array = alloc_array(new_size);
+
+        for (size_t i = 0; i <= old_array->bucket_mask; ++i) {
+            Entry & entry = old_array->entries[i];
+            if (entry.probe_distance != -1) {
+                set_helper(new_array, hash(entry.key), entry.key, entry.value);
+            }
+        }
+
+        begin_write(s);
+        s.array.store(new_array, std::memory_order_release);
+        end_write(s);
+
+        set_counts(s, new_size);
+        retire(old_array);
+    }
+
+    static void set_counts(Segment & s, size_t size) {
+        s.grow_count = size * Traits::grow_load_factor / 100;
+        if (size == Traits::initial_array_size) {
+            s.shrink_count = 0;
+        } else {
+            s.shrink_count = size * Traits::shrink_load_factor / 100;
+        }
+    }
+
+public:
+
+    SeqlockHashTable():
+        epoch(1)
+    {
+        for (size_t i = 0; i < segment_count; ++i) {
+            Segment & s = segments[i];
+            s.seq.store(0);
+            s.array.store(alloc_array(Traits::initial_array_size));
+            s.entry_count = 0;
+            set_counts(s, Traits::initial_array_size);
+        }
+        for (int i = 0; i < Traits::max_threads; ++i) {
+            readers[i].epoch.store(0);
+        }
+    }
+
+    ~SeqlockHashTable() {
+        for (size_t i = 0; i < segment_count; ++i) {
+            free_array(segments[i].array.load());
+        }
+        for (size_t i = 0; i < retired.size(); ++i) {
+            free_array(retired[i].array);
+        }
+    }
+
+    bool get(const Key & key, Value & value) {
+        size_t key_hash = hash(key);
+        Segment & s = segment(key_hash);
+        ReaderSlot & slot = enter();
+
+        while (true) {
+            size_t seq = s.seq.load(std::memory_order_acquire);
+            if (seq & 1) {
+                continue; // a writer is in the middle of a change
+            }
+
+            int found = find(s.array.load(std::memory_order_acquire), key, key_hash, s, seq, value);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (found >= 0 && s.seq.load(std::memory_order_relaxed) == seq) {
+                leave(slot);
+                return found;
+            }
+        }
+    }
+
+    bool contains(const Key & key) {
+        Value value;
+        return get(key, value);
+    }
+
+    bool set(Key key, Value value) {
+        size_t key_hash = hash(key);
+        Segment & s = segment(key_hash);
+        std::lock_guard<std::mutex> guard(s.lock);
+        Array * array = s.array.load(std::memory_order_relaxed);
+
+        begin_write(s);
+        bool added = set_helper(array, key_hash, key, value);
+        end_write(s);
+
+        if (added && ++s.entry_count >= s.grow_count) {
+            resize(s, (array->bucket_mask + 1) << 1); // double
+        }
+        return added;
+    }
+
+    // grows every segment so that n entries spread over them fit without growing again
+    void reserve(size_t n) {
+        for (size_t i = 0; i < segment_count; ++i) {
+            Segment & s = segments[i];
+            std::lock_guard<std::mutex> guard(s.lock);
+            size_t size = s.array.load(std::memory_order_relaxed)->bucket_mask + 1;
+            size_t new_size = size;
+            while (new_size * Traits::grow_load_factor / 100 <= (n >> Traits::segment_bits)) {
+                new_size <<= 1;
+            }
+            if (new_size > size) {
+                resize(s, new_size);
+            }
+        }
+    }
+
+    bool del(const Key & key) {
+        size_t key_hash = hash(key);
+        Segment & s = segment(key_hash);
+        std::lock_guard<std::mutex> guard(s.lock);
+        Array * array = s.array.load(std::memory_order_relaxed);
+
+        Entry * entry = find_locked(array, key, key_hash);
+        if (!entry) {
+            return false;
+        }
+
+        begin_write(s);
+        // move the following with PD > 0 left one position
+        size_t bucket = entry - array->entries;
+        for (;;) {
+            size_t next = (bucket + 1) & array->bucket_mask;
+            Entry & next_entry = array->entries[next];
+            if (next_entry.probe_distance == -1 || next_entry.probe_distance == 0) {
+                break;
+            }
+            Entry & entry = array->entries[bucket];
+            entry.key = next_entry.key;
+            entry.value = next_entry.value;
+            __atomic_store_n(&entry.probe_distance, next_entry.probe_distance - 1, __ATOMIC_RELAXED);
+            bucket = next;
+        }
+        __atomic_store_n(&array->entries[bucket].probe_distance, (size_t)-1, __ATOMIC_RELAXED);
+        end_write(s);
+
+        if (--s.entry_count < s.shrink_count) {
+            resize(s, (array->bucket_mask + 1) >> 1); // half
+        }
+        return true;
+    }
+
+    size_t size() {
+        size_t n = 0;
+        for (size_t i = 0; i < segment_count; ++i) {
+            std::lock_guard<std::mutex> guard(segments[i].lock);
+            n += segments[i].entry_count;
+        }
+        return n;
+    }
+};
+
+
+#include <cinttypes>
+#include "hash_policy.hpp"
+#ifndef STRING_HASH
+#define STRING_HASH fnv1a_hash
+#endif
+struct StrSeqlockHashTableTraits : SeqlockHashTableTraits<const char *, int64_t> {
+    typedef STRING_HASH hash_type;
+};
+typedef SeqlockHashTable<int64_t, int64_t> hash_t;
+typedef SeqlockHashTable<const char *, int64_t, StrSeqlockHashTableTraits> str_hash_t;
+#define HASH_THREAD_SAFE
+#define SETUP hash_t hash; str_hash_t str_hash;
+#define SETUP_RESERVED(n) SETUP hash.reserve(n);
+#define INSERT_INT_INTO_HASH(key, value) hash.set(key, value)
+#define LOOKUP_INT_IN_HASH(key) hash.contains(key)
+#define DELETE_INT_FROM_HASH(key) hash.del(key)
+#define INSERT_STR_INTO_HASH(key, value) str_hash.set(key, value)
+#define LOOKUP_STR_IN_HASH(key) str_hash.contains(key)
+#define DELETE_STR_FROM_HASH(key) str_hash.del(key)
+#include "template.c"
@@ -0,0 +1,105 @@
+#include "custom.hpp"
+
+#include <mutex>
+
+
+/*
+    A thread safe map made of 2 ** ShardBits independent Customs, each behind
+    its own lock. The shard comes from the high bits of the (mixed) hash and
+    the bucket inside the shard from the low bits, so the two don't correlate.
+*/
+template <class K, class V, size_t ShardBits = 6, class H = typename key_hash<K>::type, class P = std::equal_to<K> >
+class ShardedCustom {
+public:
+    typedef Custom<K, V, H, P> table_type;
+    typedef typename table_type::value_type value_type;
+
+    static const size_t shard_count = (size_t)1 << ShardBits;
+
+    bool get(const K & k, V & v) {
+        size_t h = table_type::hash_key(k);
+        Shard & s = shard(h);
+        std::lock_guard<std::mutex> guard(s.lock);
+        V * found = s.table.get(k, h);
+        if (!found) {
+            return false;
+        }
+        v = *found;
+        return true;
+    }
+
+    bool contains(const K & k) {
+        size_t h = table_type::hash_key(k);
+        Shard & s = shard(h);
+        std::lock_guard<std::mutex> guard(s.lock);
+        return s.table.get(k, h) != NULL;
+    }
+
+    void set(value_type && kv) {
+        size_t h = table_type::hash_key(kv.first);
+        Shard & s = shard(h);
+        std::lock_guard<std::mutex> guard(s.lock);
+        s.table.set(std::move(kv), h);
+    }
+
+    void del(const K & k) {
+        size_t h = table_type::hash_key(k);
+        Shard & s = shard(h);
+        std::lock_guard<std::mutex> guard(s.lock);
+        s.table.del(k, h);
+    }
+
+    // reserves each shard its share of n
+    void reserve(size_t n) {
+        for (size_t i = 0; i < shard_count; ++i) {
+            std::lock_guard<std::mutex> guard(_shards[i].lock);
+            _shards[i].table.reserve(n >> ShardBits);
+        }
+    }
+
+    size_t size() {
+        size_t n = 0;
+        for (size_t i = 0; i < shard_count; ++i) {
+            std::lock_guard<std::mutex> guard(_shards[i].lock);
+            n += _shards[i].table.size();
+        }
+        return n;
+    }
+
+private:
+
+    // padded to a cache line so that neighbouring locks don't false share
+    struct alignas(64) Shard {
+        std::mutex lock;
+        table_type table;
+    };
+
+    inline Shard & shard(size_t h) {
+        // H may be the identity, so mix before taking the high bits
+        return _shards[(h * 0x9E3779B97F4A7C15ull) >> (sizeof(size_t) * 8 - ShardBits)];
+    }
+
+    Shard _shards[shard_count];
+};
+
+
+#include <cinttypes>
+#include "hash_policy.hpp"
+#ifndef STRING_HASH
+#define STRING_HASH fnv1a_hash
+#endif
+#ifndef SHARD_BITS
+#define SHARD_BITS 6
+#endif
+typedef ShardedCustom<int64_t, int64_t, SHARD_BITS> hash_t;
+typedef ShardedCustom<const char *, int64_t, SHARD_BITS, STRING_HASH> str_hash_t;
+#define HASH_THREAD_SAFE
+#define SETUP hash_t hash; str_hash_t str_hash;
+#define SETUP_RESERVED(n) SETUP hash.reserve(n);
+#define INSERT_INT_INTO_HASH(key, value) hash.set(std::make_pair(key, value))
+#define LOOKUP_INT_IN_HASH(key) hash.contains(key)
+#define DELETE_INT_FROM_HASH(key) hash.del(key)
+#define INSERT_STR_INTO_HASH(key, value) str_hash.set(std::make_pair(key, value))
+#define LOOKUP_STR_IN_HASH(key) str_hash.contains(key)
+#define DELETE_STR_FROM_HASH(key) str_hash.del(key)
+#include "template.c"
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+    Where the big slot arrays of Custom and robin_hood.cc's hash_table come
+    from, picked at build time with SLOT_PAGES:
+
+    unset  malloc, or calloc for arrays that have to start zeroed
+    4      their own mmap, with transparent huge pages turned off for it
+    2048   their own mmap aligned to 2M, with MADV_HUGEPAGE, and with
+           SLOT_HUGETLB a MAP_HUGETLB mapping first if there are hugetlbfs
+           pages to be had
+
+    Mappings come zeroed from the kernel, so zeroed arrays cost nothing up
+    front, the pages being faulted in as the table fills them. Arrays under
+    SLOT_MAP_MIN bytes are always malloc'd, a table starts with a handful of
+    slots and shouldn't take a whole huge page for them. slot_free must be
+    given the same size as slot_alloc was.
+*/
+
+#ifndef SLOT_MAP_MIN
+#define SLOT_MAP_MIN (2 << 20)
+#endif
+
+#if SLOT_PAGES
+
+#include <sys/mman.h>
+#include "alloc_stats.h"
+
+#define SLOT_PAGE_BYTES ((size_t)SLOT_PAGES << 10)
+
+static size_t slot_map_size(size_t bytes)
+{
+    return (bytes + SLOT_PAGE_BYTES - 1) & ~(SLOT_PAGE_BYTES - 1);
+}
+
+static void * slot_map(size_t size)
+{
+    char * raw, * start;
+#if defined(SLOT_HUGETLB) && defined(MAP_HUGETLB)
+    start = (char *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if(start != MAP_FAILED)
+        return start;
+#endif
+
+    /* THP only backs whole aligned 2M ranges, so map a page extra and trim it to alignment */
+    if(SLOT_PAGE_BYTES <= 4096)
+    {
+        start = (char *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(start == MAP_FAILED)
+            return NULL;
+    }
+    else
+    {
+        raw = (char *)mmap(NULL, size + SLOT_PAGE_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(raw == MAP_FAILED)
+            return NULL;
+        start = (char *)(((uintptr_t)raw + SLOT_PAGE_BYTES - 1) & ~(uintptr_t)(SLOT_PAGE_BYTES - 1));
+        if(start > raw)
+            munmap(raw, start - raw);
+        munmap(start + size, raw + SLOT_PAGE_BYTES - start);
+    }
+
+#ifdef MADV_HUGEPAGE
+    madvise(start, size, SLOT_PAGE_BYTES > 4096 ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
+#endif
+    return start;
+}
+
+/* bytes of slot array, zeroed if zero, NULL if there's no memory */
+static void * slot_alloc(size_t bytes, int zero)
+{
+    void * ptr;
+    if(bytes < SLOT_MAP_MIN)
+        return zero ? calloc(bytes, 1) : malloc(bytes);
+    ptr = slot_map(slot_map_size(bytes));
+#ifdef HAVE_ALLOC_STATS
+    if(ptr)
+        alloc_stats_mapped((long)slot_map_size(bytes));
+#endif
+    return ptr;
+}
+
+static void slot_free(void * ptr, size_t bytes)
+{
+    if(bytes < SLOT_MAP_MIN)
+    {
+        free(ptr);
+        return;
+    }
+    if(!ptr)
+        return;
+    munmap(ptr, slot_map_size(bytes));
+#ifdef HAVE_ALLOC_STATS
+    alloc_stats_mapped(-(long)slot_map_size(bytes));
+#endif
+}
+
+#else
+
+static inline void * slot_alloc(size_t bytes, int zero)
+{
+    return zero ? calloc(bytes, 1) : malloc(bytes);
+}
+
+static inline void slot_free(void * ptr, size_t bytes)
+{
+    free(ptr);
+}
+
+#endif
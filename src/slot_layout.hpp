@@ -0,0 +1,225 @@
+#pragma once
+
+#include <cstddef> // size_t
+#include <cstdlib> // malloc, free
+#include <new> // placement new
+#include <utility> // move
+
+
+/*
+    How HashTable lays out its slots, picked with HashTableTraits::layout_type.
+    Every slot has a probe distance (-1 when it's empty), a key and a value:
+
+    InterleavedLayout    one array of { distance, key, value }, a hit is
+                         usually one cache line but probing drags the keys
+                         and values of every slot it passes through
+    SplitMetadataLayout  the distances in one array and { key, value } in
+                         another, so probing reads 8 bytes a slot and only
+                         the slots whose distance matches have their keys read
+    SplitLayout          distances, keys and values in three arrays, so
+                         probing only ever touches the distances and keys and
+                         only a hit reads its value
+
+    A layout is a handful of pointers, used through slot indexes. Its arrays
+    are array(0) .. array(array_count - 1), of slot_bytes(a) bytes a slot.
+*/
+template <class Layout, class Key, class Value>
+struct SlotLayout {
+    typedef Key key_type;
+    typedef Value value_type;
+
+    Layout & self() {
+        return static_cast<Layout &>(*this);
+    }
+
+    const Layout & self() const {
+        return static_cast<const Layout &>(*this);
+    }
+
+    bool allocated() const {
+        return self().array(0) != NULL;
+    }
+
+    static size_t bytes_per_slot() {
+        size_t bytes = 0;
+        for (int a = 0; a < Layout::array_count; ++a) {
+            bytes += Layout::slot_bytes(a);
+        }
+        return bytes;
+    }
+
+    // size empty slots, false (with the arrays it had left alone) if there's no memory
+    bool allocate(size_t size) {
+        void * arrays[Layout::array_count];
+        for (int a = 0; a < Layout::array_count; ++a) {
+            arrays[a] = malloc(Layout::slot_bytes(a) * size);
+            if (!arrays[a]) {
+                while (a--) {
+                    free(arrays[a]);
+                }
+                return false;
+            }
+        }
+        for (int a = 0; a < Layout::array_count; ++a) {
+            self().set_array(a, arrays[a]);
+        }
+        for (size_t i = 0; i < size; ++i) {
+            self().distance(i) = -1;
+        }
+        return true;
+    }
+
+    // frees the arrays, without destructing anything
+    void free_arrays() {
+        for (int a = 0; a < Layout::array_count; ++a) {
+            free(self().array(a));
+            self().set_array(a, NULL);
+        }
+    }
+
+    bool empty(size_t i) const {
+        return self().distance(i) == (size_t)-1;
+    }
+
+    void construct(size_t i, size_t distance, Key && key, Value && value) {
+        new (&self().key(i)) Key(std::move(key));
+        new (&self().value(i)) Value(std::move(value));
+        self().distance(i) = distance;
+    }
+
+    // destructs slot i's key and value and marks it empty
+    void destruct(size_t i) {
+        self().key(i).~Key();
+        self().value(i).~Value();
+        self().distance(i) = -1;
+    }
+};
+
+
+template <class Key, class Value>
+struct InterleavedLayout : SlotLayout<InterleavedLayout<Key, Value>, Key, Value> {
+    struct Entry {
+        size_t probe_distance;
+        Key key;
+        Value value;
+    };
+
+    static const int array_count = 1;
+
+    Entry * entries;
+
+    InterleavedLayout(): entries(NULL) {
+    }
+
+    size_t & distance(size_t i) const {
+        return entries[i].probe_distance;
+    }
+
+    Key & key(size_t i) const {
+        return entries[i].key;
+    }
+
+    Value & value(size_t i) const {
+        return entries[i].value;
+    }
+
+    void * array(int a) const {
+        return entries;
+    }
+
+    static size_t slot_bytes(int a) {
+        return sizeof(Entry);
+    }
+
+    void set_array(int a, void * array) {
+        entries = (Entry *) array;
+    }
+};
+
+
+template <class Key, class Value>
+struct SplitMetadataLayout : SlotLayout<SplitMetadataLayout<Key, Value>, Key, Value> {
+    struct Pair {
+        Key key;
+        Value value;
+    };
+
+    static const int array_count = 2;
+
+    size_t * distances;
+    Pair * pairs;
+
+    SplitMetadataLayout(): distances(NULL), pairs(NULL) {
+    }
+
+    size_t & distance(size_t i) const {
+        return distances[i];
+    }
+
+    Key & key(size_t i) const {
+        return pairs[i].key;
+    }
+
+    Value & value(size_t i) const {
+        return pairs[i].value;
+    }
+
+    void * array(int a) const {
+        return a ? (void *) pairs : (void *) distances;
+    }
+
+    static size_t slot_bytes(int a) {
+        return a ? sizeof(Pair) : sizeof(size_t);
+    }
+
+    void set_array(int a, void * array) {
+        if (a) {
+            pairs = (Pair *) array;
+        } else {
+            distances = (size_t *) array;
+        }
+    }
+};
+
+
+template <class Key, class Value>
+struct SplitLayout : SlotLayout<SplitLayout<Key, Value>, Key, Value> {
+    static const int array_count = 3;
+
+    size_t * distances;
+    Key * keys;
+    Value * values;
+
+    SplitLayout(): distances(NULL), keys(NULL), values(NULL) {
+    }
+
+    size_t & distance(size_t i) const {
+        return distances[i];
+    }
+
+    Key & key(size_t i) const {
+        return keys[i];
+    }
+
+    Value & value(size_t i) const {
+        return values[i];
+    }
+
+    void * array(int a) const {
+        return a == 2 ? (void *) values : a ? (void *) keys : (void *) distances;
+    }
+
+    static size_t slot_bytes(int a) {
+        return a == 2 ? sizeof(Value) : a ? sizeof(Key) : sizeof(size_t);
+    }
+
+    void set_array(int a, void * array) {
+        if (a == 2) {
+            values = (Value *) array;
+        } else if (a) {
+            keys = (Key *) array;
+        } else {
+            distances = (size_t *) array;
+        }
+    }
+};
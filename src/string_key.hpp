@@ -0,0 +1,169 @@
+#pragma once
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdlib.h> // malloc, free
+#include <string.h> // memcpy, memcmp, strlen
+#include <new> // bad_alloc
+
+#include "hash_policy.hpp"
+
+
+/*
+    A 16 byte string key for tables that keep their own copy of the keys.
+
+    Keys of up to 15 bytes live inline: the bytes, zero padded, with the
+    length in the last byte. Longer keys are a pointer into a StringSlab,
+    the length, the last three bytes of the key as a tag, and 0xff in the
+    last byte. So the second word alone tells most unequal keys apart, and
+    only long keys that match on length and tag get as far as memcmp.
+
+    Short keys are always inline, so equal keys always have equal flavours.
+*/
+class StringKey {
+public:
+    static const size_t max_inline = 15;
+
+    StringKey() {
+        memset(_b, 0, sizeof(_b));
+    }
+
+    // a long key refers to data without copying it, so data must outlive it
+    StringKey(const char * data, size_t size) {
+        memset(_b, 0, sizeof(_b));
+        if (size <= max_inline) {
+            memcpy(_b, data, size);
+            _b[15] = (char)size;
+        } else {
+            uint32_t size32 = (uint32_t)size;
+            memcpy(_b, &data, sizeof(data));
+            memcpy(_b + 8, &size32, sizeof(size32));
+            memcpy(_b + 12, data + size - 3, 3);
+            _b[15] = (char)out_of_line;
+        }
+    }
+
+    bool is_inline() const {
+        return (unsigned char)_b[15] != out_of_line;
+    }
+
+    const char * data() const {
+        if (is_inline()) {
+            return _b;
+        }
+        const char * data;
+        memcpy(&data, _b, sizeof(data));
+        return data;
+    }
+
+    size_t size() const {
+        if (is_inline()) {
+            return (unsigned char)_b[15];
+        }
+        uint32_t size32;
+        memcpy(&size32, _b + 8, sizeof(size32));
+        return size32;
+    }
+
+    bool operator==(const StringKey & other) const {
+        if (read_u64(_b + 8) != read_u64(other._b + 8)) {
+            return false; // length, tag or inline tail differ
+        }
+        if (is_inline()) {
+            return read_u64(_b) == read_u64(other._b);
+        }
+        const char * a = data();
+        const char * b = other.data();
+        return a == b || !memcmp(a, b, size());
+    }
+
+private:
+    static const unsigned char out_of_line = 0xff;
+
+    alignas(8) char _b[16];
+};
+
+
+// hashes the key's bytes with one of the hash_policy.hpp functors
+template <class H = fnv1a_hash>
+struct StringKeyHash {
+    size_t operator()(const StringKey & k) const {
+        return H::hash(k.data(), k.size());
+    }
+};
+
+
+/*
+    Where a table copies the bytes of its long keys: 64KB chunks handed out
+    back to back, freed all at once with the table. Deleting a key doesn't
+    give its bytes back, so the waste grows with churn of long keys.
+*/
+class StringSlab {
+public:
+    static const size_t chunk_size = 64 * 1024;
+
+    StringSlab():
+        _chunks(NULL),
+        _next(NULL),
+        _left(0),
+        _bytes(0) {
+    }
+
+    ~StringSlab() {
+        while (_chunks) {
+            Chunk * prev = _chunks->prev;
+            free(_chunks);
+            _chunks = prev;
+        }
+    }
+
+    // a key that owns its bytes: inline, or copied into the slab
+    StringKey own(const char * data, size_t size) {
+        if (size <= StringKey::max_inline) {
+            return StringKey(data, size);
+        }
+        if (size > _left) {
+            size_t bytes = size > chunk_size - sizeof(Chunk) ? size + sizeof(Chunk) : chunk_size;
+            Chunk * chunk = (Chunk *)malloc(bytes);
+            if (!chunk) {
+                throw std::bad_alloc();
+            }
+            chunk->prev = _chunks;
+            _chunks = chunk;
+            _next = (char *)(chunk + 1);
+            _left = bytes - sizeof(Chunk);
+            _bytes += bytes;
+        }
+        char * copy = _next;
+        memcpy(copy, data, size);
+        _next += size;
+        _left -= size;
+        return StringKey(copy, size);
+    }
+
+    // gives back the bytes of the last key from own(), if the table didn't keep it
+    void undo(const StringKey & k) {
+        if (!k.is_inline() && k.data() + k.size() == _next) {
+            _next -= k.size();
+            _left += k.size();
+        }
+    }
+
+    // bytes taken by the chunks so far
+    size_t bytes() const {
+        return _bytes;
+    }
+
+private:
+    struct Chunk {
+        Chunk * prev;
+    };
+
+    StringSlab(const StringSlab &);
+    StringSlab & operator=(const StringSlab &);
+
+    Chunk * _chunks; // newest first
+    char * _next;
+    size_t _left; // bytes free after _next
+    size_t _bytes;
+};
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <typeinfo>
+
+#include "fnv1a.hpp"
+
+
+/*
+    The file Custom::save and HashTable::save write and attach() maps: a
+    TableFileHeader, then the table's slot arrays as they are in memory,
+    each starting on a page boundary. Attaching maps the file copy on write
+    and points the table at the arrays, so it costs the same whatever the
+    size and the pages are only read in as lookups touch them. Only for
+    tables whose keys and values are plain bytes, not pointers.
+
+    The ids are fnv-1a of the type names of the hash function and of the
+    whole table (key, value, metadata and all), so a file is only attached
+    by the same table built by the same compiler. Everything is native
+    endian.
+*/
+
+#define TABLE_FILE_MAGIC "HTABLE2"
+#define TABLE_FILE_ALIGN 4096
+#define TABLE_FILE_ARRAYS 3
+
+struct TableFileHeader {
+    char magic[8];
+    uint32_t hash_id;
+    uint32_t layout_id;
+    uint64_t capacity; // slots
+    uint64_t size; // entries
+    uint64_t mask;
+    uint64_t slot_bytes[TABLE_FILE_ARRAYS]; // each array is capacity * slot_bytes long, 0 for no array
+    uint64_t offsets[TABLE_FILE_ARRAYS]; // from the start of the file
+};
+
+struct TableFileMap {
+    void * map;
+    size_t size;
+};
+
+template <class Table, class Hash>
+void table_file_ids(TableFileHeader & header) {
+    header.hash_id = fnv_1a<uint32_t>(typeid(Hash).name());
+    header.layout_id = fnv_1a<uint32_t>(typeid(Table).name());
+}
+
+inline uint64_t table_file_array_bytes(const TableFileHeader & header, int i) {
+    return header.capacity * header.slot_bytes[i];
+}
+
+// writes header and its arrays to path, filling in the magic and the offsets, false if it can't
+inline bool table_file_save(const char * path, TableFileHeader & header, const void * const * arrays) {
+    static const char padding[TABLE_FILE_ALIGN] = {0};
+    FILE * f = fopen(path, "wb");
+    uint64_t offset = TABLE_FILE_ALIGN;
+    bool ok = f != NULL;
+
+    memcpy(header.magic, TABLE_FILE_MAGIC, sizeof(header.magic));
+    for (int i = 0; i < TABLE_FILE_ARRAYS; ++i) {
+        header.offsets[i] = offset;
+        offset += (table_file_array_bytes(header, i) + TABLE_FILE_ALIGN - 1) / TABLE_FILE_ALIGN * TABLE_FILE_ALIGN;
+    }
+
+    ok = ok && fwrite(&header, sizeof(header), 1, f) == 1;
+    ok = ok && fwrite(padding, TABLE_FILE_ALIGN - sizeof(header), 1, f) == 1;
+    for (int i = 0; ok && i < TABLE_FILE_ARRAYS; ++i) {
+        size_t bytes = table_file_array_bytes(header, i);
+        size_t tail = (TABLE_FILE_ALIGN - bytes % TABLE_FILE_ALIGN) % TABLE_FILE_ALIGN;
+        ok = !bytes || fwrite(arrays[i], 1, bytes, f) == bytes;
+        ok = ok && (!tail || fwrite(padding, tail, 1, f) == 1);
+    }
+    if (f && fclose(f)) {
+        ok = false;
+    }
+    if (!ok) {
+        perror(path);
+    }
+    return ok;
+}
+
+inline void table_file_unmap(TableFileMap & file) {
+    if (file.map) {
+        munmap(file.map, file.size);
+    }
+    file.map = NULL;
+    file.size = 0;
+}
+
+/*
+    maps path, checks it was written by a table with expected's ids and
+    returns its header, or complains on stderr and returns NULL
+*/
+inline const TableFileHeader * table_file_map(const char * path, const TableFileHeader & expected, TableFileMap & file) {
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+
+    file.map = NULL;
+    file.size = 0;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        perror(path);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return NULL;
+    }
+    if ((size_t)st.st_size < sizeof(TableFileHeader)) {
+        fprintf(stderr, "%s: not a table file\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    // private and writable, so the table can be changed without touching the file
+    file.map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (file.map == MAP_FAILED) {
+        perror(path);
+        file.map = NULL;
+        return NULL;
+    }
+    file.size = st.st_size;
+
+    const TableFileHeader * header = (const TableFileHeader *)file.map;
+    bool ok = !memcmp(header->magic, TABLE_FILE_MAGIC, sizeof(TABLE_FILE_MAGIC)) &&
+              header->capacity && !(header->capacity & (header->capacity - 1)) &&
+              header->mask == header->capacity - 1 && header->size <= header->capacity;
+    if (!ok) {
+        fprintf(stderr, "%s: not a table file, or a damaged one\n", path);
+    } else if (header->hash_id != expected.hash_id || header->layout_id != expected.layout_id ||
+               memcmp(header->slot_bytes, expected.slot_bytes, sizeof(header->slot_bytes))) {
+        fprintf(stderr, "%s: written by a different table or hash function\n", path);
+        ok = false;
+    } else {
+        // the arrays must fit in the file, checked without multiplying the file's capacity out
+        for (int i = 0; ok && i < TABLE_FILE_ARRAYS; ++i) {
+            ok = header->offsets[i] % TABLE_FILE_ALIGN == 0 && header->offsets[i] <= file.size &&
+                 (!header->slot_bytes[i] || header->capacity <= (file.size - header->offsets[i]) / header->slot_bytes[i]);
+        }
+        if (!ok) {
+            fprintf(stderr, "%s: not a table file, or a damaged one\n", path);
+        }
+    }
+    if (!ok) {
+        table_file_unmap(file);
+        return NULL;
+    }
+
+    // lookups go all over the table, so don't read ahead
+    madvise(file.map, file.size, MADV_RANDOM);
+    return header;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+    What a table looks like inside: how far entries sit from their home
+    bucket, how full it is, how many tombstones it carries, how its bytes
+    split between per slot metadata and keys/values, and how often it has
+    rehashed. Tables fill one in with a stats() method, adapters hand it to
+    template.c with INT_HASH_STATS/STR_HASH_STATS, which prints it after the
+    fill phase (fill_ prefix) and after the timed one.
+
+    probes[d] counts the entries d slots from home, the last bucket
+    everything at TABLE_STATS_PROBE_BUCKETS - 1 or more.
+*/
+
+#define TABLE_STATS_PROBE_BUCKETS 16
+
+struct table_stats
+{
+    uint64_t size, capacity, tombstones;
+    uint64_t probes[TABLE_STATS_PROBE_BUCKETS];
+    uint64_t total_probe, max_probe;
+    uint64_t metadata_bytes, payload_bytes;
+    uint64_t rehashes;
+};
+
+static void table_stats_reset(struct table_stats * stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+/* counts one entry, dist slots from its home bucket */
+static inline void table_stats_probe(struct table_stats * stats, uint64_t dist)
+{
+    stats->probes[dist < TABLE_STATS_PROBE_BUCKETS ? dist : TABLE_STATS_PROBE_BUCKETS - 1]++;
+    stats->total_probe += dist;
+    if(dist > stats->max_probe)
+        stats->max_probe = dist;
+}
+
+/* appends " <prefix>load=... <prefix>probe_hist=n0:n1:..." to buf */
+static void table_stats_format(const struct table_stats * stats, const char * prefix, char * buf, size_t size)
+{
+    size_t len = strlen(buf);
+    int i, last;
+
+    snprintf(buf + len, size - len, " %sload=%.3f %savg_probe=%.3f %smax_probe=%llu %stombstones=%llu %smeta_bytes=%llu %spayload_bytes=%llu %srehashes=%llu %sprobe_hist=",
+             prefix, stats->capacity ? (double)stats->size / stats->capacity : 0.0,
+             prefix, stats->size ? (double)stats->total_probe / stats->size : 0.0,
+             prefix, (unsigned long long)stats->max_probe, prefix, (unsigned long long)stats->tombstones,
+             prefix, (unsigned long long)stats->metadata_bytes, prefix, (unsigned long long)stats->payload_bytes,
+             prefix, (unsigned long long)stats->rehashes, prefix);
+
+    /* trailing empty buckets are left off */
+    for(last = TABLE_STATS_PROBE_BUCKETS - 1; last > 0 && !stats->probes[last]; last--)
+        ;
+    for(i = 0; i <= last; i++)
+    {
+        len = strlen(buf);
+        snprintf(buf + len, size - len, i ? ":%llu" : "%llu", (unsigned long long)stats->probes[i]);
+    }
+}
@@ -1,11 +1,20 @@
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <time.h>
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <math.h>
+#include <stdint.h>
+#include <limits.h>
+#include "alloc_stats.h"
+#include "key_pool.h"
+#include "latency_hist.h"
+#include "perf_counters.h"
+#include "workload.h"
+#include "trace.h"
 
 /*
     insert new items
@@ -17,6 +26,64 @@
     insert then delete
 */
 
+/* keys per call in the lookupbatch modes */
+#ifndef LOOKUP_BATCH_SIZE
+#define LOOKUP_BATCH_SIZE 64
+#endif
+
+/* churn reports its throughput and probe lengths for this many equal stretches of the run */
+#ifndef CHURN_INTERVALS
+#define CHURN_INTERVALS 8
+#endif
+
+/* tables without a batch api look the keys up one at a time */
+#ifndef LOOKUP_INT_BATCH_IN_HASH
+#define LOOKUP_INT_BATCH_IN_HASH(keys, n) do { \
+        int batch_i; \
+        for(batch_i = 0; batch_i < (n); batch_i++) \
+            LOOKUP_INT_IN_HASH((keys)[batch_i]); \
+    } while(0)
+#endif
+
+/* string keys from the key pool come with their lengths, for tables that can take one instead of calling strlen */
+#ifndef INSERT_STR_LEN_INTO_HASH
+#define INSERT_STR_LEN_INTO_HASH(key, len, value) INSERT_STR_INTO_HASH(key, value)
+#endif
+#ifndef LOOKUP_STR_LEN_IN_HASH
+#define LOOKUP_STR_LEN_IN_HASH(key, len) LOOKUP_STR_IN_HASH(key)
+#endif
+#ifndef DELETE_STR_LEN_FROM_HASH
+#define DELETE_STR_LEN_FROM_HASH(key, len) DELETE_STR_FROM_HASH(key)
+#endif
+
+#ifndef LOOKUP_STR_BATCH_IN_HASH
+#define LOOKUP_STR_BATCH_IN_HASH(keys, n) do { \
+        int batch_i; \
+        for(batch_i = 0; batch_i < (n); batch_i++) \
+            LOOKUP_STR_IN_HASH((keys)[batch_i]); \
+    } while(0)
+#endif
+
+/* tables without a bulk api insert the keys one at a time */
+#ifndef BULK_LOAD_INT_INTO_HASH
+#define BULK_LOAD_INT_INTO_HASH(keys, values, n, threads) do { \
+        int bulk_i; \
+        for(bulk_i = 0; bulk_i < (n); bulk_i++) \
+            INSERT_INT_INTO_HASH((keys)[bulk_i], (values)[bulk_i]); \
+    } while(0)
+#endif
+
+/* strided's keys are this far apart, a power of two like the table sizes, so a table that buckets by the key's low bits piles them up */
+#define STRIDE 256
+
+/* rangescan's ranges hold this many keys on average */
+#define RANGE_KEYS 100
+
+/* SETUP with the int table sized for n keys, tables that can't be sized up front just start empty */
+#ifndef SETUP_RESERVED
+#define SETUP_RESERVED(n) SETUP
+#endif
+
 double get_time(void)
 {
     struct timeval tv;
@@ -24,94 +91,793 @@ double get_time(void)
     return tv.tv_sec + (tv.tv_usec / 1000000.0);
 }
 
-char * new_string_from_integer(int num)
+/*
+    -l N times every Nth operation of the timed loop into latency (every
+    batch for the batch modes), filllatency times all of them. Not in the
+    threaded modes.
+*/
+static struct latency_hist latency;
+static int sample_every = 0, sample_count = 0;
+
+#define TIMED(op) do { \
+        if(sample_every && ++sample_count == sample_every) \
+        { \
+            uint64_t timed_start = latency_ticks(); \
+            op; \
+            latency_record(&latency, latency_ticks() - timed_start); \
+            sample_count = 0; \
+        } \
+        else \
+        { \
+            op; \
+        } \
+    } while(0)
+
+/* one operation of the ycsb modes (workload.h) */
+#define WORKLOAD_OP(op, key) do { \
+        switch(op) \
+        { \
+            case WORKLOAD_READ: \
+                LOOKUP_INT_IN_HASH(key); \
+                break; \
+            case WORKLOAD_UPDATE: \
+            case WORKLOAD_INSERT: \
+                INSERT_INT_INTO_HASH(key, value); \
+                break; \
+            case WORKLOAD_RMW: \
+                LOOKUP_INT_IN_HASH(key); \
+                INSERT_INT_INTO_HASH(key, value); \
+                break; \
+            default: \
+                DELETE_INT_FROM_HASH(key); \
+                break; \
+        } \
+    } while(0)
+
+/* one operation of a replayed trace (trace.h), KIND is INT or STR */
+#define TRACE_OP(KIND, record, key) do { \
+        switch((record)->op) \
+        { \
+            case TRACE_INSERT: \
+                INSERT_##KIND##_INTO_HASH(key, trace_values ? (record)->value : value); \
+                break; \
+            case TRACE_LOOKUP: \
+                LOOKUP_##KIND##_IN_HASH(key); \
+                break; \
+            case TRACE_DELETE: \
+                DELETE_##KIND##_FROM_HASH(key); \
+                break; \
+        } \
+    } while(0)
+
+/*
+    The jth key churn inserts: j shuffled by xorshifts and odd multiplies
+    mod 2 ** 31, each of which is a bijection, so the keys are distinct for
+    j < 2 ** 31 but land all over even a table with an identity hash.
+*/
+static inline int churn_key(int64_t j)
 {
-    int ndigits = num == 0 ? 1 : (int)log10(num) + 1;
-    char * str = (char *)malloc(ndigits + 1);
-    sprintf(str, "%d", num);
-    return str;
+    uint32_t x = (uint32_t)j & 0x7fffffff;
+    x ^= x >> 15;
+    x = (x * 0x2c1b3c6du) & 0x7fffffff;
+    x ^= x >> 12;
+    x = (x * 0x297a2d39u) & 0x7fffffff;
+    x ^= x >> 15;
+    return (int)x;
 }
 
-int main(int argc, char ** argv)
+static struct alloc_stats fill_stats, op_stats;
+static struct perf_counters perf;
+
+/*
+    Tables that can describe themselves (table_stats.h) define
+    INT_HASH_STATS(stats) and STR_HASH_STATS(stats). They're read at the end
+    of the fill phase, before the timing starts, and after the timed one.
+*/
+#if defined(INT_HASH_STATS) && defined(STR_HASH_STATS)
+#include "table_stats.h"
+#define HAVE_TABLE_STATS
+static struct table_stats fill_table_stats, op_table_stats;
+static int have_fill_table_stats = 0;
+
+#define TABLE_STATS(stats) do { \
+        if(string_keys) \
+            STR_HASH_STATS(stats); \
+        else \
+            INT_HASH_STATS(stats); \
+    } while(0)
+#define FILL_TABLE_STATS() do { \
+        TABLE_STATS(fill_table_stats); \
+        have_fill_table_stats = 1; \
+    } while(0)
+#else
+#define FILL_TABLE_STATS() do { } while(0)
+#endif
+
+/* ends the fill phase (if any) and starts timing the operations */
+double start_timing(void)
 {
-    int num_keys = atoi(argv[1]);
+#ifdef HAVE_ALLOC_STATS
+    alloc_stats_end(&fill_stats);
+    alloc_stats_phase();
+#endif
+    perf_counters_start(&perf);
+    return get_time();
+}
+
+#ifdef HASH_THREAD_SAFE
+/*
+    -t THREADS splits the operations of an int benchmark between threads
+    pinned to separate cores. Only for tables that define HASH_THREAD_SAFE,
+    which are all C++, so the workers can take the table by reference.
+
+    sequential, random, delete and lookup do the same as the single
+    threaded versions. mixed does 90% lookups, 5% inserts and 5% deletes
+    over the keys 0..num_keys, readmostly 95% lookups and 2.5% of each.
+*/
+#include <pthread.h>
+#include <sched.h>
+
+struct thread_args
+{
+    hash_t * hash;
+    const char * benchtype;
+    int thread, num_threads, num_keys;
+    pthread_barrier_t * start;
+};
+
+/* xorshift64*, random() would serialise the threads on its lock */
+static uint64_t next_random(uint64_t * state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ull;
+}
+
+static void thread_ops(hash_t & hash, struct thread_args * args)
+{
+    const char * benchtype = args->benchtype;
+    int num_keys = args->num_keys;
+    int begin = (int)((int64_t)num_keys * args->thread / args->num_threads);
+    int end = (int)((int64_t)num_keys * (args->thread + 1) / args->num_threads);
+    uint64_t state = 0x9E3779B97F4A7C15ull * (args->thread + 1);
     int i, value = 0;
 
-    if(argc <= 2)
-        return 1;
+    if(!strcmp(benchtype, "sequential"))
+    {
+        for(i = begin; i < end; i++)
+            INSERT_INT_INTO_HASH(i, value);
+    }
 
-    SETUP
+    else if(!strcmp(benchtype, "random"))
+    {
+        for(i = begin; i < end; i++)
+            INSERT_INT_INTO_HASH((int)(next_random(&state) & 0x7fffffff), value);
+    }
 
-    double before = get_time();
+    else if(!strcmp(benchtype, "delete"))
+    {
+        for(i = begin; i < end; i++)
+            DELETE_INT_FROM_HASH(i);
+    }
+
+    else if(!strcmp(benchtype, "lookup"))
+    {
+        for(i = begin; i < end; i++)
+            LOOKUP_INT_IN_HASH((int)(next_random(&state) & 0x7fffffff));
+    }
 
-    if(!strcmp(argv[2], "sequential"))
+    else if(!strcmp(benchtype, "mixed") || !strcmp(benchtype, "readmostly"))
+    {
+        /* per mille: lookups below the first, inserts below the second, deletes above */
+        int lookups = !strcmp(benchtype, "mixed") ? 900 : 950;
+        int inserts = lookups + (1000 - lookups) / 2;
+        for(i = begin; i < end; i++)
+        {
+            uint64_t r = next_random(&state);
+            int key = (int)((r >> 32) % num_keys);
+            int op = (int)((r & 0xffff) % 1000);
+            if(op < lookups)
+                LOOKUP_INT_IN_HASH(key);
+            else if(op < inserts)
+                INSERT_INT_INTO_HASH(key, value);
+            else
+                DELETE_INT_FROM_HASH(key);
+        }
+    }
+}
+
+static void * thread_main(void * arg)
+{
+    struct thread_args * args = (struct thread_args *)arg;
+    cpu_set_t cpus;
+
+    CPU_ZERO(&cpus);
+    CPU_SET(args->thread % sysconf(_SC_NPROCESSORS_ONLN), &cpus);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+
+    pthread_barrier_wait(args->start);
+    thread_ops(*args->hash, args);
+    return NULL;
+}
+
+/* fills the table if the benchmark needs it, then times the threads from *before */
+static int run_threads(hash_t & hash, const char * benchtype, int num_keys, int num_threads, double * before)
+{
+    pthread_t * threads;
+    struct thread_args * args;
+    pthread_barrier_t start;
+    int i, value = 0;
+
+    if(strcmp(benchtype, "sequential") && strcmp(benchtype, "random") && strcmp(benchtype, "delete") &&
+       strcmp(benchtype, "lookup") && strcmp(benchtype, "mixed") && strcmp(benchtype, "readmostly"))
+    {
+        fprintf(stderr, "%s: no threaded version\n", benchtype);
+        return 1;
+    }
+
+    if(strcmp(benchtype, "sequential") && strcmp(benchtype, "random"))
     {
         for(i = 0; i < num_keys; i++)
             INSERT_INT_INTO_HASH(i, value);
     }
 
-    else if(!strcmp(argv[2], "random"))
+    threads = (pthread_t *)malloc(sizeof(pthread_t) * num_threads);
+    args = (struct thread_args *)malloc(sizeof(struct thread_args) * num_threads);
+    pthread_barrier_init(&start, NULL, num_threads + 1);
+    for(i = 0; i < num_threads; i++)
+    {
+        args[i].hash = &hash;
+        args[i].benchtype = benchtype;
+        args[i].thread = i;
+        args[i].num_threads = num_threads;
+        args[i].num_keys = num_keys;
+        args[i].start = &start;
+        pthread_create(&threads[i], NULL, thread_main, &args[i]);
+    }
+
+    /* on the clock before the barrier lets the workers go, so none of their work goes untimed */
+    *before = start_timing();
+    pthread_barrier_wait(&start);
+    for(i = 0; i < num_threads; i++)
+        pthread_join(threads[i], NULL);
+
+    pthread_barrier_destroy(&start);
+    free(threads);
+    free(args);
+    return 0;
+}
+#endif
+
+int main(int argc, char ** argv)
+{
+    int num_keys, i, value = 0;
+    int64_t num_ops;
+    int num_threads = 0, key_width = 0, opt;
+    const char * benchtype, * workload_spec = "", * file_path = NULL;
+    int string_keys;
+    struct key_pool pool = { NULL, NULL, NULL, 0 };
+    struct workload workload;
+    struct workload_ops ops = { NULL, NULL, 0, 0 };
+    struct trace trace = { NULL, 0, NULL, NULL, NULL };
+    int64_t * bulk_keys = NULL, * bulk_values = NULL;
+    double ticks_per_ns = 1;
+    double perf_values[PERF_COUNTER_COUNT];
+    int churn_rounds = 0;
+    int64_t range_span = 0, range_found = 0;
+    double churn_ops_per_sec[CHURN_INTERVALS], churn_avg_probe[CHURN_INTERVALS];
+    char extra_fields[2048] = "";
+#ifdef SAVE_INT_HASH
+    char default_file_path[1024];
+#endif
+
+    while((opt = getopt(argc, argv, "t:k:l:w:f:")) != -1)
     {
+        switch(opt)
+        {
+            case 't':
+                num_threads = atoi(optarg);
+                break;
+            case 'k':
+                /* zero pad the string keys to this many digits */
+                key_width = atoi(optarg);
+                break;
+            case 'l':
+                sample_every = atoi(optarg);
+                break;
+            case 'w':
+                /* changes to the ycsb preset, see workload_parse() */
+                workload_spec = optarg;
+                break;
+            case 'f':
+                /* the trace to replay, or the table file of save and load */
+                file_path = optarg;
+                break;
+            default:
+                return 1;
+        }
+    }
+
+    if(argc - optind < 2)
+        return 1;
+
+    num_keys = atoi(argv[optind]);
+    benchtype = argv[optind + 1];
+    num_ops = num_keys;
+
+    /* string keys are made up front so the timing and memory numbers are the table's alone */
+    string_keys = strstr(benchtype, "string") != NULL;
+    if(string_keys)
+        key_pool_build(&pool, num_keys, key_width, !strcmp(benchtype, "randomstring"));
+    /* and so are the operations of "ycsb-<preset>" */
+    if(!strncmp(benchtype, "ycsb", 4))
+    {
+        if(workload_preset(&workload, !benchtype[4] ? "a" : benchtype[4] == '-' ? benchtype + 5 : ""))
+        {
+            fprintf(stderr, "%s: no such workload\n", benchtype);
+            return 1;
+        }
+        if(workload_parse(&workload, workload_spec))
+            return 1;
+        workload_generate(&workload, num_keys, num_keys, &ops);
+    }
+    /* bulkload builds the table from the keys of random in one call, -t THREADS for the table's threads */
+    if(!strcmp(benchtype, "bulkload"))
+    {
+        bulk_keys = (int64_t *)malloc(sizeof(int64_t) * num_keys);
+        bulk_values = (int64_t *)malloc(sizeof(int64_t) * num_keys);
         srandom(1); // for a fair/deterministic comparison
         for(i = 0; i < num_keys; i++)
-            INSERT_INT_INTO_HASH((int)random(), value);
+        {
+            bulk_keys[i] = (int)random();
+            bulk_values[i] = value;
+        }
+    }
+    /* replay maps its trace, and replays the first num_keys operations (all for 0) */
+    if(!strcmp(benchtype, "replay"))
+    {
+        if(!file_path)
+        {
+            fprintf(stderr, "replay: needs -f TRACE\n");
+            return 1;
+        }
+        if(trace_open(&trace, file_path))
+            return 1;
+        /* the harness counts operations in an int */
+        if(!num_keys && trace.header->count > INT_MAX)
+        {
+            fprintf(stderr, "%s: more than %d records, replay fewer of them\n", file_path, INT_MAX);
+            return 1;
+        }
+        if(!num_keys || (uint64_t)num_keys > trace.header->count)
+            num_keys = (int)trace.header->count;
+        string_keys = trace.header->flags & TRACE_STRING_KEYS;
+    }
+    /* "churn-<rounds>" replaces every key rounds times, 4 by default, as an insert and a delete each */
+    if(!strncmp(benchtype, "churn", 5))
+    {
+        churn_rounds = benchtype[5] == '-' ? atoi(benchtype + 6) : 4;
+        if(churn_rounds < 1 || (int64_t)num_keys * (churn_rounds + 1) > 0x7fffffff)
+        {
+            fprintf(stderr, "%s: need 1 or more rounds, and fewer than 2 ** 31 keys over all of them\n", benchtype);
+            return 1;
+        }
+        num_ops = (int64_t)num_keys * churn_rounds * 2;
+    }
+    /* save fills the table like random, and saves it afterwards, load attaches a table of the same keys */
+    if(!strcmp(benchtype, "save") || !strcmp(benchtype, "load"))
+    {
+#ifdef SAVE_INT_HASH
+        if(!file_path)
+        {
+            snprintf(default_file_path, sizeof(default_file_path), "%s-%s-%d.table", argv[0], benchtype, num_keys);
+            file_path = default_file_path;
+        }
+        ticks_per_ns = latency_ticks_per_ns();
+        /* built and saved by a child, so none of it is left in this process */
+        if(!strcmp(benchtype, "load"))
+        {
+            int status;
+            pid_t child = fork();
+            if(!child)
+            {
+                SETUP
+                srandom(1);
+                for(i = 0; i < num_keys; i++)
+                    INSERT_INT_INTO_HASH((int)random(), value);
+                _exit(SAVE_INT_HASH(file_path) ? 0 : 1);
+            }
+            if(child < 0 || waitpid(child, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status))
+            {
+                fprintf(stderr, "%s: couldn't save the table to load\n", file_path);
+                return 1;
+            }
+        }
+#else
+        fprintf(stderr, "%s: %s needs a table that defines SAVE_INT_HASH\n", argv[0], benchtype);
+        return 1;
+#endif
+    }
+    /* rangescan fills the table like random, then counts the keys in num_keys / RANGE_KEYS ranges of random starts */
+    if(!strcmp(benchtype, "rangescan"))
+    {
+#ifdef RANGE_COUNT_INT_IN_HASH
+        num_ops = num_keys / RANGE_KEYS ? num_keys / RANGE_KEYS : 1;
+        range_span = ((int64_t)RANGE_KEYS << 31) / (num_keys ? num_keys : 1);
+#else
+        fprintf(stderr, "%s: rangescan needs a table that defines RANGE_COUNT_INT_IN_HASH\n", argv[0]);
+        return 1;
+#endif
+    }
+    if(!strcmp(benchtype, "filllatency"))
+        sample_every = 1;
+    if(sample_every)
+    {
+        latency_reset(&latency);
+        ticks_per_ns = latency_ticks_per_ns();
+    }
+
+    perf_counters_open(&perf);
+
+#ifdef HAVE_ALLOC_STATS
+    alloc_stats_begin();
+#endif
+    /* the presized modes size the table for num_keys here, so the memory counts it but the time is the inserts' alone */
+    SETUP_RESERVED(strstr(benchtype, "presized") ? num_keys : 0)
+    double before = start_timing();
+
+    if(num_threads && strcmp(benchtype, "bulkload"))
+    {
+#ifdef HASH_THREAD_SAFE
+        if(run_threads(hash, benchtype, num_keys, num_threads, &before))
+            return 1;
+#else
+        fprintf(stderr, "%s: -t needs a table that defines HASH_THREAD_SAFE\n", argv[0]);
+        return 1;
+#endif
     }
 
-    else if(!strcmp(argv[2], "delete"))
+    else if(!strcmp(benchtype, "sequential") || !strcmp(benchtype, "sequentialpresized") || !strcmp(benchtype, "filllatency"))
+    {
+        /* filllatency is sequential with every insert timed, to catch the rehash stalls */
+        for(i = 0; i < num_keys; i++)
+            TIMED(INSERT_INT_INTO_HASH(i, value));
+    }
+
+    else if(!strcmp(benchtype, "random") || !strcmp(benchtype, "randompresized") || !strcmp(benchtype, "save"))
+    {
+        srandom(1); // for a fair/deterministic comparison
+        for(i = 0; i < num_keys; i++)
+            TIMED(INSERT_INT_INTO_HASH((int)random(), value));
+    }
+
+    else if(!strcmp(benchtype, "strided"))
+    {
+        for(i = 0; i < num_keys; i++)
+            TIMED(INSERT_INT_INTO_HASH((int64_t)i * STRIDE, value));
+    }
+
+    else if(!strcmp(benchtype, "delete"))
     {
         for(i = 0; i < num_keys; i++)
             INSERT_INT_INTO_HASH(i, value);
-        before = get_time();
+        FILL_TABLE_STATS();
+        before = start_timing();
         for(i = 0; i < num_keys; i++)
-            DELETE_INT_FROM_HASH(i);
+            TIMED(DELETE_INT_FROM_HASH(i));
     }
 
-    else if(!strcmp(argv[2], "lookup"))
+    else if(!strcmp(benchtype, "lookup"))
     {
         srandom(1); // for a fair/deterministic comparison
         for(i = 0; i < num_keys; i++)
             INSERT_INT_INTO_HASH(i, value);
-        before = get_time();
+        FILL_TABLE_STATS();
+        before = start_timing();
         for(i = 0; i < num_keys; i++)
-            LOOKUP_INT_IN_HASH((int)random());
+            TIMED(LOOKUP_INT_IN_HASH((int)random()));
     }
 
-    else if(!strcmp(argv[2], "sequentialstring"))
+    else if(!strcmp(benchtype, "lookuphit") || !strcmp(benchtype, "lookupmiss"))
     {
+        /* the keys of random looked up again, or for lookupmiss keys from 2 ** 31 up, which never went in */
+        int64_t miss = !strcmp(benchtype, "lookupmiss") ? (int64_t)1 << 31 : 0;
+        srandom(1);
         for(i = 0; i < num_keys; i++)
-            INSERT_STR_INTO_HASH(new_string_from_integer(i), value);
+            INSERT_INT_INTO_HASH((int)random(), value);
+        FILL_TABLE_STATS();
+        srandom(1);
+        before = start_timing();
+        for(i = 0; i < num_keys; i++)
+            TIMED(LOOKUP_INT_IN_HASH(miss + (int)random()));
     }
 
-    else if(!strcmp(argv[2], "randomstring"))
+#ifdef RANGE_COUNT_INT_IN_HASH
+    else if(!strcmp(benchtype, "rangescan"))
     {
+        int64_t lo;
+        srandom(1);
+        for(i = 0; i < num_keys; i++)
+            INSERT_INT_INTO_HASH((int)random(), value);
+        FILL_TABLE_STATS();
+        before = start_timing();
+        for(i = 0; i < num_ops; i++)
+        {
+            lo = (int)random();
+            TIMED(range_found += RANGE_COUNT_INT_IN_HASH(lo, lo + range_span));
+        }
+    }
+#endif
+
+    else if(!strcmp(benchtype, "lookupbatch"))
+    {
+        int64_t batch[LOOKUP_BATCH_SIZE];
+        int j;
         srandom(1); // for a fair/deterministic comparison
         for(i = 0; i < num_keys; i++)
-            INSERT_STR_INTO_HASH(new_string_from_integer((int)random()), value);
+            INSERT_INT_INTO_HASH(i, value);
+        FILL_TABLE_STATS();
+        before = start_timing();
+        for(i = 0; i < num_keys; i += LOOKUP_BATCH_SIZE)
+        {
+            int n = num_keys - i < LOOKUP_BATCH_SIZE ? num_keys - i : LOOKUP_BATCH_SIZE;
+            for(j = 0; j < n; j++)
+                batch[j] = (int)random();
+            TIMED(LOOKUP_INT_BATCH_IN_HASH(batch, n));
+        }
+    }
+
+    else if(!strcmp(benchtype, "sequentialstring") || !strcmp(benchtype, "randomstring"))
+    {
+        for(i = 0; i < num_keys; i++)
+            TIMED(INSERT_STR_LEN_INTO_HASH(pool.keys[i], pool.lengths[i], value));
     }
 
-    else if(!strcmp(argv[2], "deletestring"))
+    else if(!strcmp(benchtype, "deletestring"))
     {
         for(i = 0; i < num_keys; i++)
-            INSERT_STR_INTO_HASH(new_string_from_integer(i), value);
-        before = get_time();
+            INSERT_STR_LEN_INTO_HASH(pool.keys[i], pool.lengths[i], value);
+        FILL_TABLE_STATS();
+        before = start_timing();
         for(i = 0; i < num_keys; i++)
-            DELETE_STR_FROM_HASH(new_string_from_integer(i));
+            TIMED(DELETE_STR_LEN_FROM_HASH(pool.keys[i], pool.lengths[i]));
     }
 
-    else if(!strcmp(argv[2], "lookupstring"))
+    else if(!strcmp(benchtype, "lookupstring"))
     {
         srandom(1); // for a fair/deterministic comparison
-        char ** str_keys = (char**)malloc(sizeof(char*) * num_keys);
         for(i = 0; i < num_keys; i++)
-            INSERT_STR_INTO_HASH(new_string_from_integer(i), value);
-            str_keys[i] = new_string_from_integer(i);
-        before = get_time();
+            INSERT_STR_LEN_INTO_HASH(pool.keys[i], pool.lengths[i], value);
+        FILL_TABLE_STATS();
+        before = start_timing();
         for(i = 0; i < num_keys; i++)
-            LOOKUP_STR_IN_HASH(str_keys[(int)random() % num_keys]);
+        {
+            int k = (int)random() % num_keys;
+            TIMED(LOOKUP_STR_LEN_IN_HASH(pool.keys[k], pool.lengths[k]));
+        }
+    }
+
+    else if(!strcmp(benchtype, "lookupbatchstring"))
+    {
+        const char * batch[LOOKUP_BATCH_SIZE];
+        int j;
+        srandom(1); // for a fair/deterministic comparison
+        for(i = 0; i < num_keys; i++)
+            INSERT_STR_LEN_INTO_HASH(pool.keys[i], pool.lengths[i], value);
+        FILL_TABLE_STATS();
+        before = start_timing();
+        for(i = 0; i < num_keys; i += LOOKUP_BATCH_SIZE)
+        {
+            int n = num_keys - i < LOOKUP_BATCH_SIZE ? num_keys - i : LOOKUP_BATCH_SIZE;
+            for(j = 0; j < n; j++)
+                batch[j] = pool.keys[(int)random() % num_keys];
+            TIMED(LOOKUP_STR_BATCH_IN_HASH(batch, n));
+        }
+    }
+
+    else if(!strncmp(benchtype, "ycsb", 4))
+    {
+        for(i = 0; i < num_keys; i++)
+            INSERT_INT_INTO_HASH(i, value);
+        for(i = 0; i < ops.warmup; i++)
+            WORKLOAD_OP(ops.ops[i], ops.keys[i]);
+        FILL_TABLE_STATS();
+        before = start_timing();
+        for(; i < ops.warmup + ops.count; i++)
+            TIMED(WORKLOAD_OP(ops.ops[i], ops.keys[i]));
+    }
+
+    else if(churn_rounds)
+    {
+        /*
+            num_keys keys stay live throughout, each insert of a new key
+            followed by the delete of the oldest. The probe lengths are read
+            between stretches with the clock (and counters) stopped.
+        */
+        int64_t pairs = (int64_t)num_keys * churn_rounds, j;
+        int interval;
+        for(i = 0; i < num_keys; i++)
+            INSERT_INT_INTO_HASH(churn_key(i), value);
+        FILL_TABLE_STATS();
+        before = start_timing();
+        for(interval = 0; interval < CHURN_INTERVALS; interval++)
+        {
+            int64_t begin = pairs * interval / CHURN_INTERVALS, end = pairs * (interval + 1) / CHURN_INTERVALS;
+            double interval_start = get_time(), paused;
+            for(j = begin; j < end; j++)
+            {
+                TIMED(INSERT_INT_INTO_HASH(churn_key(num_keys + j), value));
+                TIMED(DELETE_INT_FROM_HASH(churn_key(j)));
+            }
+            paused = get_time();
+            churn_ops_per_sec[interval] = paused > interval_start ? 2 * (end - begin) / (paused - interval_start) : 0.0;
+            churn_avg_probe[interval] = -1;
+#ifdef HAVE_TABLE_STATS
+            perf_counters_stop(&perf);
+            INT_HASH_STATS(op_table_stats);
+            churn_avg_probe[interval] = op_table_stats.size ? (double)op_table_stats.total_probe / op_table_stats.size : 0.0;
+            perf_counters_resume(&perf);
+#endif
+            before += get_time() - paused;
+        }
+    }
+
+    else if(!strcmp(benchtype, "bulkload"))
+    {
+        BULK_LOAD_INT_INTO_HASH(bulk_keys, bulk_values, num_keys, num_threads ? num_threads : 1);
+    }
+
+#ifdef ATTACH_INT_HASH
+    else if(!strcmp(benchtype, "load"))
+    {
+        if(!ATTACH_INT_HASH(file_path))
+        {
+            unlink(file_path);
+            return 1;
+        }
+    }
+#endif
+
+    else if(!strcmp(benchtype, "replay"))
+    {
+        int trace_values = trace.header->flags & TRACE_VALUES;
+        if(string_keys)
+        {
+            for(i = 0; i < num_keys; i++)
+            {
+                const struct trace_record * record = trace_record(&trace, i);
+                TIMED(TRACE_OP(STR, record, trace.strings + record->key));
+            }
+        }
+        else
+        {
+            for(i = 0; i < num_keys; i++)
+            {
+                const struct trace_record * record = trace_record(&trace, i);
+                TIMED(TRACE_OP(INT, record, record->key));
+            }
+        }
     }
 
     double after = get_time();
-    printf("%f\n", after-before);
+    perf_counters_stop(&perf);
+#ifdef HAVE_ALLOC_STATS
+    alloc_stats_end(&op_stats);
+#endif
+
+#ifdef SAVE_INT_HASH
+    /*
+        save and load, off the clock: the first lookup, which for load is
+        the first to touch the file, then looking up every key, then save's
+        save. load's file was the child's, save's is its own.
+    */
+    if(!strcmp(benchtype, "save") || !strcmp(benchtype, "load"))
+    {
+        size_t len = strlen(extra_fields);
+        int found = 0;
+        uint64_t first_start;
+        double first_ns, lookup_start, lookup_seconds, save_start;
+
+        srandom(1);
+        first_start = latency_ticks();
+        found += LOOKUP_INT_IN_HASH((int)random());
+        first_ns = (latency_ticks() - first_start) / ticks_per_ns;
+        lookup_start = get_time();
+        for(i = 1; i < num_keys; i++)
+            found += LOOKUP_INT_IN_HASH((int)random());
+        lookup_seconds = get_time() - lookup_start;
+        if(found != num_keys)
+        {
+            fprintf(stderr, "%s: found %d of %d keys\n", benchtype, found, num_keys);
+            unlink(file_path);
+            return 1;
+        }
+        snprintf(extra_fields + len, sizeof(extra_fields) - len, " first_lookup_ns=%.0f lookup_seconds=%f", first_ns, lookup_seconds);
+
+        if(!strcmp(benchtype, "save"))
+        {
+            save_start = get_time();
+            if(!SAVE_INT_HASH(file_path))
+                return 1;
+            len = strlen(extra_fields);
+            snprintf(extra_fields + len, sizeof(extra_fields) - len, " save_seconds=%f", get_time() - save_start);
+        }
+        unlink(file_path);
+    }
+#endif
+
+    /* every mode does num_keys operations in its timed part, but churn */
+    perf_counters_read(&perf, perf_values);
+    for(i = 0; i < PERF_COUNTER_COUNT; i++)
+    {
+        size_t len = strlen(extra_fields);
+        if(perf_values[i] >= 0 && num_ops)
+            snprintf(extra_fields + len, sizeof(extra_fields) - len, " %s_per_op=%.3f",
+                     perf_counter_names[i], perf_values[i] / (double)num_ops);
+    }
+
+    if(sample_every && latency.total)
+    {
+        size_t len = strlen(extra_fields);
+        snprintf(extra_fields + len, sizeof(extra_fields) - len, " p50_ns=%.0f p90_ns=%.0f p99_ns=%.0f p999_ns=%.0f max_ns=%.0f samples=%llu",
+                 latency_percentile(&latency, 0.5) / ticks_per_ns, latency_percentile(&latency, 0.9) / ticks_per_ns,
+                 latency_percentile(&latency, 0.99) / ticks_per_ns, latency_percentile(&latency, 0.999) / ticks_per_ns,
+                 latency.max / ticks_per_ns, (unsigned long long)latency.total);
+    }
+
+    if(trace.map)
+    {
+        size_t len = strlen(extra_fields);
+        snprintf(extra_fields + len, sizeof(extra_fields) - len, " ops_per_sec=%.0f", after > before ? num_keys / (after - before) : 0.0);
+    }
+
+    /* churn's stretches in order, e.g. churn_ops_per_sec=9000000:8500000:... */
+    if(churn_rounds)
+    {
+        size_t len = strlen(extra_fields);
+        snprintf(extra_fields + len, sizeof(extra_fields) - len, " ops_per_sec=%.0f churn_ops_per_sec=", after > before ? num_ops / (after - before) : 0.0);
+        for(i = 0; i < CHURN_INTERVALS; i++)
+        {
+            len = strlen(extra_fields);
+            snprintf(extra_fields + len, sizeof(extra_fields) - len, i ? ":%.0f" : "%.0f", churn_ops_per_sec[i]);
+        }
+        if(churn_avg_probe[0] >= 0)
+        {
+            for(i = 0; i < CHURN_INTERVALS; i++)
+            {
+                len = strlen(extra_fields);
+                snprintf(extra_fields + len, sizeof(extra_fields) - len, i ? ":%.3f" : " churn_avg_probe=%.3f", churn_avg_probe[i]);
+            }
+        }
+    }
+
+    /* rangescan's counts, which ordered tables have to agree on */
+    if(range_span)
+    {
+        size_t len = strlen(extra_fields);
+        snprintf(extra_fields + len, sizeof(extra_fields) - len, " scans=%lld scanned=%lld keys_per_scan=%.1f",
+                 (long long)num_ops, (long long)range_found, range_found / (double)num_ops);
+    }
+
+#ifdef HAVE_TABLE_STATS
+    if(have_fill_table_stats)
+        table_stats_format(&fill_table_stats, "fill_", extra_fields, sizeof(extra_fields));
+    TABLE_STATS(op_table_stats);
+    table_stats_format(&op_table_stats, "", extra_fields, sizeof(extra_fields));
+#endif
+
+#ifdef HAVE_ALLOC_STATS
+    printf("%f live=%ld peak=%ld allocs=%ld fill_live=%ld fill_peak=%ld fill_allocs=%ld%s\n", after-before,
+           op_stats.live, op_stats.peak, op_stats.allocs, fill_stats.live, fill_stats.peak, fill_stats.allocs, extra_fields);
+#else
+    printf("%f%s\n", after-before, extra_fields);
+#endif
     fflush(stdout);
+    key_pool_free(&pool);
+    workload_ops_free(&ops);
+    trace_close(&trace);
+    free(bulk_keys);
+    free(bulk_values);
     sleep(1000000);
 }
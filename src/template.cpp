@@ -1,6 +1,8 @@
 #include <benchmark/benchmark.h>
 #include <stdlib.h>  // srandom, random
 
+#include "perf_counters.h"
+
 
 /*
     set missing items
@@ -17,9 +19,49 @@
 */
 
 
+// the timed parts of each benchmark also run the perf_counters.h counters,
+// reported per iteration next to the time
+static struct perf_counters perf;
+static int perf_opened = perf_counters_open(&perf);
+
+
+static void resume_timing(benchmark::State& state) {
+    state.ResumeTiming();
+    perf_counters_resume(&perf);
+}
+
+
+static void pause_timing(benchmark::State& state) {
+    perf_counters_stop(&perf);
+    state.PauseTiming();
+}
+
+
+static void reset_counters() {
+    perf_counters_start(&perf);
+    perf_counters_stop(&perf);
+}
+
+
+static void report_counters(benchmark::State& state) {
+    double values[PERF_COUNTER_COUNT];
+    perf_counters_stop(&perf);
+    if (!perf_opened) {
+        return;
+    }
+    perf_counters_read(&perf, values);
+    for (int i = 0; i < PERF_COUNTER_COUNT; ++i) {
+        if (values[i] >= 0) {
+            state.counters[perf_counter_names[i]] = benchmark::Counter(values[i], benchmark::Counter::kAvgIterations);
+        }
+    }
+}
+
+
 static void BM_Set(benchmark::State& state) {
+    reset_counters();
     while (state.KeepRunning()) {
-        state.PauseTiming();
+        pause_timing(state);
 
         SETUP
         srandom(1);
@@ -31,13 +73,14 @@ static void BM_Set(benchmark::State& state) {
 
         for (int i = 0; i < state.range(1); ++i) {
             long value = random();
-            state.ResumeTiming();
+            resume_timing(state);
             INSERT_INT_INTO_HASH(value, value);
-            state.PauseTiming();
+            pause_timing(state);
         }
 
-        state.ResumeTiming();
+        resume_timing(state);
     }
+    report_counters(state);
 }
 
 
@@ -45,8 +88,9 @@ BENCHMARK(BM_Set)->RangeMultiplier(10)->Ranges({{1, 1000}, {1, 1000}});
 
 
 static void BM_SetNew(benchmark::State& state) {
+    reset_counters();
     while (state.KeepRunning()) {
-        state.PauseTiming();
+        pause_timing(state);
 
         SETUP
         srandom(1);
@@ -61,10 +105,11 @@ static void BM_SetNew(benchmark::State& state) {
             missing_value = random();
         } while (LOOKUP_INT_IN_HASH(missing_value));
 
-        state.ResumeTiming();
+        resume_timing(state);
 
         INSERT_INT_INTO_HASH(missing_value, missing_value);
     }
+    report_counters(state);
 }
 
 
@@ -72,8 +117,9 @@ BENCHMARK(BM_SetNew)->RangeMultiplier(10)->Range(1, 1000);
 
 
 static void BM_SetExisting(benchmark::State& state) {
+    reset_counters();
     while (state.KeepRunning()) {
-        state.PauseTiming();
+        pause_timing(state);
 
         SETUP
         srandom(1);
@@ -84,10 +130,11 @@ static void BM_SetExisting(benchmark::State& state) {
             INSERT_INT_INTO_HASH(value, value);
         }
 
-        state.ResumeTiming();
+        resume_timing(state);
 
         INSERT_INT_INTO_HASH(value, value);
     }
+    report_counters(state);
 }
 
 
@@ -95,8 +142,9 @@ BENCHMARK(BM_SetExisting)->RangeMultiplier(10)->Range(1, 1000);
 
 
 static void BM_LookupMissing(benchmark::State& state) {
+    reset_counters();
     while (state.KeepRunning()) {
-        state.PauseTiming();
+        pause_timing(state);
 
         SETUP
         srandom(1);
@@ -111,10 +159,11 @@ static void BM_LookupMissing(benchmark::State& state) {
             missing_value = random();
         } while (LOOKUP_INT_IN_HASH(missing_value));
 
-        state.ResumeTiming();
+        resume_timing(state);
 
         LOOKUP_INT_IN_HASH(missing_value);
     }
+    report_counters(state);
 }
 
 
@@ -122,8 +171,9 @@ BENCHMARK(BM_LookupMissing)->RangeMultiplier(10)->Range(1, 1000);
 
 
 static void BM_LookupExisting(benchmark::State& state) {
+    reset_counters();
     while (state.KeepRunning()) {
-        state.PauseTiming();
+        pause_timing(state);
 
         SETUP
         srandom(1);
@@ -134,10 +184,11 @@ static void BM_LookupExisting(benchmark::State& state) {
             INSERT_INT_INTO_HASH(value, value);
         }
 
-        state.ResumeTiming();
+        resume_timing(state);
 
         LOOKUP_INT_IN_HASH(value);
     }
+    report_counters(state);
 }
 
 
@@ -145,8 +196,9 @@ BENCHMARK(BM_LookupExisting)->RangeMultiplier(10)->Range(1, 1000);
 
 
 static void BM_DeleteMissing(benchmark::State& state) {
+    reset_counters();
     while (state.KeepRunning()) {
-        state.PauseTiming();
+        pause_timing(state);
 
         SETUP
         srandom(1);
@@ -161,10 +213,11 @@ static void BM_DeleteMissing(benchmark::State& state) {
             missing_value = random();
         } while (LOOKUP_INT_IN_HASH(missing_value));
 
-        state.ResumeTiming();
+        resume_timing(state);
 
         DELETE_INT_FROM_HASH(missing_value);
     }
+    report_counters(state);
 }
 
 
@@ -172,8 +225,9 @@ BENCHMARK(BM_DeleteMissing)->RangeMultiplier(10)->Range(1, 1000);
 
 
 static void BM_DeleteExisting(benchmark::State& state) {
+    reset_counters();
     while (state.KeepRunning()) {
-        state.PauseTiming();
+        pause_timing(state);
 
         SETUP
         srandom(1);
@@ -184,10 +238,11 @@ static void BM_DeleteExisting(benchmark::State& state) {
             INSERT_INT_INTO_HASH(value, value);
         }
 
-        state.ResumeTiming();
+        resume_timing(state);
 
         DELETE_INT_FROM_HASH(value);
     }
+    report_counters(state);
 }
 
 
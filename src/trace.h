@@ -0,0 +1,147 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+    A recorded sequence of operations, mapped read only so replaying it
+    doesn't parse or allocate anything. make_trace.py writes them.
+
+    The file is a trace_header, count records record_size bytes apart from
+    records_offset, then strings_size bytes of nul terminated keys from
+    strings_offset. A record's key is the key itself, or with
+    TRACE_STRING_KEYS the offset of the key in the strings, every distinct
+    key being there once so a key is always the same pointer. The value is
+    only there with TRACE_VALUES, records are 16 bytes apart without it.
+    Everything is little endian.
+*/
+
+#define TRACE_MAGIC "HTRACE1"
+
+enum
+{
+    TRACE_INSERT = 1,
+    TRACE_LOOKUP = 2,
+    TRACE_DELETE = 3
+};
+
+#define TRACE_STRING_KEYS 1
+#define TRACE_VALUES 2
+
+struct trace_header
+{
+    char magic[8];
+    uint32_t flags;
+    uint32_t record_size;
+    uint64_t count;
+    uint64_t records_offset;
+    uint64_t strings_offset;
+    uint64_t strings_size;
+};
+
+struct trace_record
+{
+    int64_t key;
+    uint32_t op;
+    uint32_t reserved;
+    int64_t value; /* only with TRACE_VALUES */
+};
+
+struct trace
+{
+    void * map;
+    size_t map_size;
+    const struct trace_header * header;
+    const char * records;
+    const char * strings;
+};
+
+static inline const struct trace_record * trace_record(const struct trace * trace, uint64_t i)
+{
+    return (const struct trace_record *)(trace->records + i * trace->header->record_size);
+}
+
+static void trace_close(struct trace * trace)
+{
+    if(trace->map)
+        munmap(trace->map, trace->map_size);
+    memset(trace, 0, sizeof(*trace));
+}
+
+/* maps the trace at path, returns -1 and complains on stderr if it can't */
+static int trace_open(struct trace * trace, const char * path)
+{
+    struct stat st;
+    const struct trace_header * header;
+    int fd = open(path, O_RDONLY), flags = MAP_PRIVATE;
+
+    memset(trace, 0, sizeof(*trace));
+    if(fd < 0 || fstat(fd, &st) < 0)
+    {
+        perror(path);
+        if(fd >= 0)
+            close(fd);
+        return -1;
+    }
+    if((size_t)st.st_size < sizeof(struct trace_header))
+    {
+        fprintf(stderr, "%s: not a trace\n", path);
+        close(fd);
+        return -1;
+    }
+
+#ifdef MAP_POPULATE
+    flags |= MAP_POPULATE; /* fault it all in now rather than while timing */
+#endif
+    trace->map = mmap(NULL, st.st_size, PROT_READ, flags, fd, 0);
+    close(fd);
+    if(trace->map == MAP_FAILED)
+    {
+        perror(path);
+        trace->map = NULL;
+        return -1;
+    }
+    trace->map_size = st.st_size;
+
+    header = (const struct trace_header *)trace->map;
+    if(memcmp(header->magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) ||
+       header->record_size < (header->flags & TRACE_VALUES ? sizeof(struct trace_record) : 16) ||
+       header->records_offset % 8 || header->record_size % 8 ||
+       header->records_offset > trace->map_size ||
+       header->count > (trace->map_size - header->records_offset) / header->record_size ||
+       header->strings_offset > trace->map_size ||
+       header->strings_size > trace->map_size - header->strings_offset ||
+       (header->strings_size && ((const char *)trace->map)[header->strings_offset + header->strings_size - 1]))
+    {
+        fprintf(stderr, "%s: not a trace, or a damaged one\n", path);
+        trace_close(trace);
+        return -1;
+    }
+
+    trace->header = header;
+    trace->records = (const char *)trace->map + header->records_offset;
+    trace->strings = (const char *)trace->map + header->strings_offset;
+
+    /* string keys must start inside the strings, which end with a nul */
+    if(header->flags & TRACE_STRING_KEYS)
+    {
+        uint64_t i;
+        for(i = 0; i < header->count; i++)
+        {
+            if((uint64_t)trace_record(trace, i)->key >= header->strings_size)
+            {
+                fprintf(stderr, "%s: record %llu has a key outside the strings\n", path, (unsigned long long)i);
+                trace_close(trace);
+                return -1;
+            }
+        }
+    }
+
+    madvise(trace->map, trace->map_size, MADV_SEQUENTIAL);
+    return 0;
+}
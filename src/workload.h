@@ -0,0 +1,303 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+    YCSB style mixed workloads over the int keys. The table is loaded with
+    the keys 0..records-1, then each operation is a read, an update (an
+    insert of a key that's there, or was), an insert of the next new key,
+    a delete or a read-modify-write (a read then an update of the same key,
+    one operation), picked by the ratios, on a key picked by the distribution:
+
+    uniform   every key as likely as the next
+    zipfian   a few keys get most of the operations, how few set by theta
+              (0 < theta < 1, YCSB's 0.99 by default), spread over the key
+              space by hashing the popularity rank like YCSB's scrambled
+              zipfian
+    latest    zipfian by age, the most recently inserted keys are the hot ones
+    hotspot   hot_ops of the operations go to the lowest hot_keys of the keys
+
+    The presets are YCSB's core workloads, E (scans) aside, plus "hot":
+
+    a  50% read  50% update  zipfian
+    b  95% read   5% update  zipfian
+    c 100% read              zipfian
+    d  95% read   5% insert  latest
+    f  50% read  50% read-modify-write  zipfian
+    hot 95% read  5% update  hotspot, 80% of the ops on 20% of the keys
+
+    The whole stream of operations is generated up front, so the timing is
+    the table's alone: warmup * count operations that aren't timed, then
+    count that are.
+*/
+
+enum
+{
+    WORKLOAD_UNIFORM,
+    WORKLOAD_ZIPFIAN,
+    WORKLOAD_LATEST,
+    WORKLOAD_HOTSPOT
+};
+
+enum
+{
+    WORKLOAD_READ,
+    WORKLOAD_UPDATE,
+    WORKLOAD_INSERT,
+    WORKLOAD_DELETE,
+    WORKLOAD_RMW
+};
+
+struct workload
+{
+    double read, update, insert, remove, rmw; /* ratios, needn't add up to 1 */
+    int distribution;
+    double theta; /* zipfian and latest */
+    double hot_keys, hot_ops; /* hotspot, fractions of the keys and of the operations */
+    double warmup; /* untimed operations, as a fraction of the timed ones */
+};
+
+struct workload_ops
+{
+    unsigned char * ops;
+    int * keys;
+    int warmup, count; /* ops[0..warmup) warm up, ops[warmup..warmup+count) are timed */
+};
+
+static const char * const workload_distributions[] = { "uniform", "zipfian", "latest", "hotspot" };
+
+/* sets *wl to a preset, returns -1 if there's no such preset */
+static int workload_preset(struct workload * wl, const char * name)
+{
+    memset(wl, 0, sizeof(*wl));
+    wl->distribution = WORKLOAD_ZIPFIAN;
+    wl->theta = 0.99;
+    wl->hot_keys = 0.2;
+    wl->hot_ops = 0.8;
+    wl->warmup = 0.1;
+
+    if(!strcmp(name, "a"))
+    {
+        wl->read = 0.5;
+        wl->update = 0.5;
+    }
+    else if(!strcmp(name, "b"))
+    {
+        wl->read = 0.95;
+        wl->update = 0.05;
+    }
+    else if(!strcmp(name, "c"))
+    {
+        wl->read = 1;
+    }
+    else if(!strcmp(name, "f"))
+    {
+        wl->read = 0.5;
+        wl->rmw = 0.5;
+    }
+    else if(!strcmp(name, "d"))
+    {
+        wl->read = 0.95;
+        wl->insert = 0.05;
+        wl->distribution = WORKLOAD_LATEST;
+    }
+    else if(!strcmp(name, "hot"))
+    {
+        wl->read = 0.95;
+        wl->update = 0.05;
+        wl->distribution = WORKLOAD_HOTSPOT;
+    }
+    else
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+    changes *wl by a spec like "read=0.9,update=0.05,delete=0.05,dist=hotspot",
+    the names being read, update, insert, delete, rmw, dist, theta,
+    hot_keys, hot_ops and warmup. Returns -1 and complains on stderr if it's bad.
+*/
+static int workload_parse(struct workload * wl, const char * spec)
+{
+    char name[32], value[32];
+    int n, i;
+
+    while(*spec)
+    {
+        if(sscanf(spec, "%31[^=,]=%31[^,]%n", name, value, &n) != 2)
+        {
+            fprintf(stderr, "workload: can't parse \"%s\"\n", spec);
+            return -1;
+        }
+        spec += n;
+        if(*spec == ',')
+            spec++;
+
+        if(!strcmp(name, "dist"))
+        {
+            for(i = 0; i < 4 && strcmp(value, workload_distributions[i]); i++)
+                ;
+            if(i == 4)
+            {
+                fprintf(stderr, "workload: no distribution \"%s\"\n", value);
+                return -1;
+            }
+            wl->distribution = i;
+        }
+        else if(!strcmp(name, "read"))
+            wl->read = atof(value);
+        else if(!strcmp(name, "update"))
+            wl->update = atof(value);
+        else if(!strcmp(name, "insert"))
+            wl->insert = atof(value);
+        else if(!strcmp(name, "delete"))
+            wl->remove = atof(value);
+        else if(!strcmp(name, "rmw"))
+            wl->rmw = atof(value);
+        else if(!strcmp(name, "theta"))
+            wl->theta = atof(value);
+        else if(!strcmp(name, "hot_keys"))
+            wl->hot_keys = atof(value);
+        else if(!strcmp(name, "hot_ops"))
+            wl->hot_ops = atof(value);
+        else if(!strcmp(name, "warmup"))
+            wl->warmup = atof(value);
+        else
+        {
+            fprintf(stderr, "workload: no setting \"%s\"\n", name);
+            return -1;
+        }
+    }
+
+    if(wl->read + wl->update + wl->insert + wl->remove + wl->rmw <= 0 ||
+       wl->read < 0 || wl->update < 0 || wl->insert < 0 || wl->remove < 0 || wl->rmw < 0)
+    {
+        fprintf(stderr, "workload: the ratios must be >= 0 and not all 0\n");
+        return -1;
+    }
+    if(wl->theta <= 0 || wl->theta >= 1 || wl->hot_keys <= 0 || wl->hot_keys > 1 || wl->hot_ops < 0 || wl->hot_ops > 1 || wl->warmup < 0)
+    {
+        fprintf(stderr, "workload: need 0 < theta < 1, 0 < hot_keys <= 1, 0 <= hot_ops <= 1 and warmup >= 0\n");
+        return -1;
+    }
+    return 0;
+}
+
+/* xorshift64*, the same stream on every run */
+static inline double workload_random(uint64_t * state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return ((*state * 2685821657736338717ull) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/*
+    Gray et al.'s zipfian generator, as in YCSB, over ranks 0..n-1 with 0
+    the most popular. n only grows, zeta is brought up to date as it does.
+*/
+struct workload_zipf
+{
+    double theta, alpha, zeta2, zetan, eta;
+    int64_t n;
+};
+
+static void workload_zipf_grow(struct workload_zipf * z, int64_t n)
+{
+    for(; z->n < n; z->n++)
+        z->zetan += 1 / pow((double)(z->n + 1), z->theta);
+    z->eta = (1 - pow(2.0 / n, 1 - z->theta)) / (1 - z->zeta2 / z->zetan);
+}
+
+static void workload_zipf_init(struct workload_zipf * z, double theta, int64_t n)
+{
+    z->theta = theta;
+    z->alpha = 1 / (1 - theta);
+    z->zeta2 = 1 + 1 / pow(2.0, theta);
+    z->zetan = 0;
+    z->n = 0;
+    workload_zipf_grow(z, n);
+}
+
+static inline int64_t workload_zipf_next(const struct workload_zipf * z, double u)
+{
+    double uz = u * z->zetan;
+    int64_t rank;
+    if(uz < 1)
+        return 0;
+    if(uz < 1 + pow(0.5, z->theta))
+        return 1;
+    rank = (int64_t)(z->n * pow(z->eta * u - z->eta + 1, z->alpha));
+    return rank < z->n ? rank : z->n - 1;
+}
+
+/* the operations of a run on a table loaded with keys 0..records-1 */
+static void workload_generate(const struct workload * wl, int records, int count, struct workload_ops * out)
+{
+    double total = wl->read + wl->update + wl->insert + wl->remove + wl->rmw;
+    double read = wl->read / total, update = read + wl->update / total, insert = update + wl->insert / total;
+    double remove = insert + wl->remove / total;
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    struct workload_zipf zipf;
+    int64_t next_key = records > 0 ? records : 1;
+    int i;
+
+    out->warmup = (int)(wl->warmup * count);
+    out->count = count;
+    out->ops = (unsigned char *)malloc(out->warmup + count);
+    out->keys = (int *)malloc(sizeof(int) * (out->warmup + count));
+
+    if(wl->distribution == WORKLOAD_ZIPFIAN || wl->distribution == WORKLOAD_LATEST)
+        workload_zipf_init(&zipf, wl->theta, next_key);
+
+    for(i = 0; i < out->warmup + count; i++)
+    {
+        double r = workload_random(&state);
+        int op = r < read ? WORKLOAD_READ : r < update ? WORKLOAD_UPDATE : r < insert ? WORKLOAD_INSERT :
+                 r < remove ? WORKLOAD_DELETE : WORKLOAD_RMW;
+        int64_t key, hot;
+
+        if(op == WORKLOAD_INSERT)
+        {
+            key = next_key++;
+            if(wl->distribution == WORKLOAD_ZIPFIAN || wl->distribution == WORKLOAD_LATEST)
+                workload_zipf_grow(&zipf, next_key);
+        }
+        else switch(wl->distribution)
+        {
+            case WORKLOAD_ZIPFIAN:
+                key = workload_zipf_next(&zipf, workload_random(&state));
+                key = (int64_t)(((uint64_t)key * 0x9E3779B97F4A7C15ull) % (uint64_t)next_key);
+                break;
+            case WORKLOAD_LATEST:
+                key = next_key - 1 - workload_zipf_next(&zipf, workload_random(&state));
+                break;
+            case WORKLOAD_HOTSPOT:
+                hot = (int64_t)(wl->hot_keys * next_key);
+                hot = hot < 1 ? 1 : hot;
+                if(hot >= next_key || workload_random(&state) < wl->hot_ops)
+                    key = (int64_t)(workload_random(&state) * hot);
+                else
+                    key = hot + (int64_t)(workload_random(&state) * (next_key - hot));
+                break;
+            default:
+                key = (int64_t)(workload_random(&state) * next_key);
+                break;
+        }
+
+        out->ops[i] = (unsigned char)op;
+        out->keys[i] = (int)key;
+    }
+}
+
+static void workload_ops_free(struct workload_ops * ops)
+{
+    free(ops->ops);
+    free(ops->keys);
+}